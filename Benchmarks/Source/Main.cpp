@@ -0,0 +1,218 @@
+// Times the plugin's PartitionedConvolver against juce::dsp::Convolution on the same work: one mono
+// source through a stereo HRIR pair, at host block sizes 32 .. 1024 with 256 and 512 tap IRs.
+// Also times the convolver taking a new kernel every block, which is how the plugin drives it.
+// Then the convolver's inner loops compiled for fixed sizes against the generic ones (the same class
+// prepared with specialisedLoops off), at partition sizes 32 .. 512 with 256 / 512 / 1024 taps, and how
+// far apart their outputs are.
+//
+// Build the Release configuration and run it on an otherwise idle machine:
+//     "Annie's 3D Panner Benchmarks" [seconds of audio per case, default 10]
+// Each case is the best of five runs; ns per sample and the share of real time at 48 kHz.
+#include <JuceHeader.h>
+#include <iostream>
+#include "../../Source/PartitionedConvolver.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numRuns = 5;
+    constexpr int numSwitchKernels = 8; // more than the convolver stages, so every switch is transformed
+
+    // decaying noise with a fixed seed, so every run times the same IRs
+    juce::AudioBuffer<float> makeHRIR (int length, int seed)
+    {
+        juce::AudioBuffer<float> ir (2, length);
+        juce::Random random (seed);
+
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < length; ++i)
+                ir.setSample (ch, i, (random.nextFloat() * 2.0f - 1.0f) * std::exp (-5.0f * (float) i / (float) length));
+
+        return ir;
+    }
+
+    // best of numRuns, each over numBlocks calls
+    double bestNsPerSample (int numBlocks, int blockSize, const std::function<void (int)>& processBlock)
+    {
+        double best = std::numeric_limits<double>::max();
+
+        for (int run = 0; run < numRuns; ++run)
+        {
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            for (int b = 0; b < numBlocks; ++b)
+                processBlock (b);
+
+            const double seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start);
+            best = juce::jmin (best, seconds * 1.0e9 / ((double) numBlocks * blockSize));
+        }
+
+        return best;
+    }
+
+    juce::String describe (double nsPerSample)
+    {
+        return juce::String (nsPerSample, 1).paddedLeft (' ', 8) + " ns ("
+             + juce::String (nsPerSample * sampleRate * 1.0e-7, 2).paddedLeft (' ', 5) + "%)";
+    }
+
+    void runCase (int blockSize, int irLength, double secondsPerCase)
+    {
+        const auto ir = makeHRIR (irLength, irLength);
+        const int numBlocks = juce::jmax (1, (int) (secondsPerCase * sampleRate) / blockSize);
+
+        juce::AudioBuffer<float> input (2, blockSize), juceOut (2, blockSize), ownOut (2, blockSize);
+        juce::Random random (1);
+        for (int i = 0; i < blockSize; ++i)
+            input.setSample (0, i, random.nextFloat() * 2.0f - 1.0f);
+        input.copyFrom (1, 0, input, 0, 0, blockSize);
+
+        PartitionedConvolver convolver;
+        convolver.prepare (blockSize);
+        convolver.setKernel (0, ir.getReadPointer (0), ir.getReadPointer (1), irLength);
+
+        juce::dsp::Convolution convolution;
+        convolution.prepare ({ sampleRate, (juce::uint32) blockSize, 2 });
+        convolution.loadImpulseResponse (juce::AudioBuffer<float> (ir), sampleRate, juce::dsp::Convolution::Stereo::yes,
+                                         juce::dsp::Convolution::Trim::no, juce::dsp::Convolution::Normalise::yes);
+
+        const juce::dsp::AudioBlock<const float> inBlock (input);
+        juce::dsp::AudioBlock<float> outBlock (juceOut);
+
+        auto processJuce = [&] (int) { convolution.process (juce::dsp::ProcessContextNonReplacing<float> (inBlock, outBlock)); };
+        auto processOwn  = [&] (int) { convolver.process (input.getReadPointer (0), ownOut.getWritePointer (0), ownOut.getWritePointer (1), blockSize); };
+
+        // the IR is loaded on a background thread and faded in by process(); feed both the same stream until
+        // it's in and a second of audio has gone through, then they should agree
+        for (int waited = 0; convolution.getCurrentIRSize() != irLength && waited < 5000; ++waited)
+        {
+            processJuce (0);
+            processOwn (0);
+            juce::Thread::sleep (1);
+        }
+
+        for (int b = 0; b < (int) sampleRate / blockSize + 1; ++b)
+        {
+            processJuce (b);
+            processOwn (b);
+        }
+
+        float maxDifference = 0.0f;
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                maxDifference = juce::jmax (maxDifference, std::abs (juceOut.getSample (ch, i) - ownOut.getSample (ch, i)));
+
+        const double juceNs = bestNsPerSample (numBlocks, blockSize, processJuce);
+        const double ownNs = bestNsPerSample (numBlocks, blockSize, processOwn);
+
+        // the plugin's case: a different HRIR pair every block (juce::dsp::Convolution loads them asynchronously,
+        // so it has no equivalent)
+        std::vector<juce::AudioBuffer<float>> kernels;
+        for (int k = 0; k < numSwitchKernels; ++k)
+            kernels.push_back (makeHRIR (irLength, 1000 + k));
+
+        const double switchingNs = bestNsPerSample (numBlocks, blockSize, [&] (int b)
+        {
+            const auto& kernel = kernels[(size_t) (b % numSwitchKernels)];
+            convolver.setKernel (1 + b % numSwitchKernels, kernel.getReadPointer (0), kernel.getReadPointer (1), irLength);
+            processOwn (b);
+        });
+
+        std::cout << juce::String (blockSize).paddedLeft (' ', 5) << juce::String (irLength).paddedLeft (' ', 6)
+                  << "  " << describe (juceNs) << "  " << describe (ownNs) << "  x" << juce::String (juceNs / ownNs, 2).paddedRight (' ', 6)
+                  << describe (switchingNs) << "   " << juce::String (juce::Decibels::gainToDecibels (maxDifference, -200.0f), 1) << " dB"
+                  << std::endl;
+    }
+
+    // fixed kernel and a new one every block, each with both sets of inner loops
+    void runVariantCase (int partitionSize, int irLength, double secondsPerCase)
+    {
+        const int numBlocks = juce::jmax (1, (int) (secondsPerCase * sampleRate) / partitionSize);
+
+        std::vector<juce::AudioBuffer<float>> kernels;
+        for (int k = 0; k < numSwitchKernels; ++k)
+            kernels.push_back (makeHRIR (irLength, 2000 + k));
+
+        juce::AudioBuffer<float> input (1, partitionSize), specialisedOut (2, partitionSize), genericOut (2, partitionSize);
+        juce::Random random (1);
+        for (int i = 0; i < partitionSize; ++i)
+            input.setSample (0, i, random.nextFloat() * 2.0f - 1.0f);
+
+        auto setKernel = [&] (PartitionedConvolver& convolver, int b)
+        {
+            const auto& kernel = kernels[(size_t) (b % numSwitchKernels)];
+            convolver.setKernel (b % numSwitchKernels, kernel.getReadPointer (0), kernel.getReadPointer (1), irLength);
+        };
+
+        auto time = [&] (bool specialised, bool switching)
+        {
+            PartitionedConvolver convolver;
+            convolver.prepare (partitionSize, specialised);
+            setKernel (convolver, 0);
+
+            return bestNsPerSample (numBlocks, partitionSize, [&] (int b)
+            {
+                if (switching)
+                    setKernel (convolver, b);
+
+                convolver.process (input.getReadPointer (0), specialisedOut.getWritePointer (0), specialisedOut.getWritePointer (1), partitionSize);
+            });
+        };
+
+        const double fixedSpecialised = time (true, false), fixedGeneric = time (false, false);
+        const double switchingSpecialised = time (true, true), switchingGeneric = time (false, true);
+
+        // the same input and kernel changes through both, relative to the output's peak
+        PartitionedConvolver specialised, generic;
+        specialised.prepare (partitionSize, true);
+        generic.prepare (partitionSize, false);
+
+        float maxDifference = 0.0f, peak = 0.0f;
+        for (int b = 0; b < 4 * numSwitchKernels; ++b)
+        {
+            setKernel (specialised, b / 2);
+            setKernel (generic, b / 2);
+            specialised.process (input.getReadPointer (0), specialisedOut.getWritePointer (0), specialisedOut.getWritePointer (1), partitionSize);
+            generic.process (input.getReadPointer (0), genericOut.getWritePointer (0), genericOut.getWritePointer (1), partitionSize);
+
+            for (int ch = 0; ch < 2; ++ch)
+            {
+                for (int i = 0; i < partitionSize; ++i)
+                {
+                    maxDifference = juce::jmax (maxDifference, std::abs (specialisedOut.getSample (ch, i) - genericOut.getSample (ch, i)));
+                    peak = juce::jmax (peak, std::abs (genericOut.getSample (ch, i)));
+                }
+            }
+        }
+
+        std::cout << juce::String (partitionSize).paddedLeft (' ', 9) << juce::String (irLength).paddedLeft (' ', 6)
+                  << "  " << describe (fixedSpecialised) << "  " << describe (fixedGeneric) << "  x" << juce::String (fixedGeneric / fixedSpecialised, 2).paddedRight (' ', 6)
+                  << describe (switchingSpecialised) << "  " << describe (switchingGeneric) << "  x" << juce::String (switchingGeneric / switchingSpecialised, 2).paddedRight (' ', 6)
+                  << juce::String (juce::Decibels::gainToDecibels (peak > 0.0f ? maxDifference / peak : 0.0f, -200.0f), 1) << " dB"
+                  << std::endl;
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    const double secondsPerCase = argc > 1 ? juce::jmax (0.1, juce::String (argv[1]).getDoubleValue()) : 10.0;
+
+    std::cout << juce::SystemStats::getCpuModel() << ", " << juce::SystemStats::getJUCEVersion() << std::endl
+              << "ns per sample (share of real time at 48 kHz), best of " << numRuns << " runs of "
+              << secondsPerCase << " s each" << std::endl
+              << "block  taps  juce::dsp::Convolution  PartitionedConvolver     speed-up  new kernel per block  difference" << std::endl;
+
+    for (int irLength : { 256, 512 })
+        for (int blockSize = 32; blockSize <= 1024; blockSize *= 2)
+            runCase (blockSize, irLength, secondsPerCase);
+
+    std::cout << std::endl
+              << "PartitionedConvolver inner loops, fixed kernel / new kernel per block" << std::endl
+              << "partition  taps         specialised               generic     speed-up        specialised               generic     speed-up  difference" << std::endl;
+
+    for (int irLength : { 256, 512, 1024 })
+        for (int partitionSize = 32; partitionSize <= 512; partitionSize *= 2)
+            runVariantCase (partitionSize, irLength, secondsPerCase);
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include "BasisRenderer.h"
+
+namespace {
+    constexpr size_t alignment = 64;
+}
+
+void BasisRenderer::prepare (int newBlockSize)
+{
+    blockSize = newBlockSize;
+    fftSize = 2 * blockSize;
+    binStride = PartitionedConvolver::Transform::getBinStride (blockSize);
+    maxPartitions = (maxKernelLength + blockSize - 1) / blockSize;
+
+    // sized for the most components a database can have, so a new one never allocates
+    const size_t spectrumFloats = 2 * (size_t) binStride;
+    const size_t spectraFloats = (size_t) maxChannels * (size_t) maxPartitions * spectrumFloats;
+    const size_t total = spectraFloats + (size_t) maxChannels * (size_t) fftSize + 2 * (size_t) fftSize + spectrumFloats;
+
+    storage.assign (total + alignment / sizeof (float), 0.0f);
+
+    auto* p = reinterpret_cast<float*> ((reinterpret_cast<uintptr_t> (storage.data()) + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    auto carve = [&p] (size_t numFloats) { auto* start = p; p += numFloats; return start; };
+
+    fdl = carve (spectraFloats);
+    frames = carve ((size_t) maxChannels * (size_t) fftSize);
+    fftBuffer = carve (2 * (size_t) fftSize);
+    acc = carve (spectrumFloats);
+    transform.prepare (blockSize, fftBuffer);
+
+    filters = nullptr;
+    numChannels = numPartitions = 0;
+    reset();
+}
+
+void BasisRenderer::reset()
+{
+    // only the channels the current basis uses are ever read
+    const int channels = numChannels * 2;
+    std::fill (fdl, fdl + (size_t) channels * (size_t) maxPartitions * 2 * (size_t) binStride, 0.0f);
+    std::fill (frames, frames + (size_t) channels * (size_t) fftSize, 0.0f);
+    fdlHead = 0;
+
+    // weights and delays fade in from silence, indices are only meaningful for one database
+    for (auto& s : sources)
+    {
+        s.delayLine.fill (0.0f);
+        s.writePos = 0;
+        s.delayIndex = s.weightIndex = -1;
+        s.delays[0] = s.delays[1] = 0;
+        s.weights.fill (0.0f);
+    }
+}
+
+void BasisRenderer::setBasis (const HRTFDatabase& db)
+{
+    if (!db.hasBasis() || fftBuffer == nullptr || blockSize != HRTFDatabase::basisPartitionSize)
+    {
+        filters = nullptr;
+        numChannels = numPartitions = 0;
+        reset();
+        return;
+    }
+
+    // transformed when the set was loaded, with the kernel normalisation in the weights
+    jassert (binStride == HRTFDatabase::basisBinStride && db.getNumBasisPartitions() <= maxPartitions);
+    filters = db.getBasisSpectrum (0, 0, 0);
+    numChannels = db.getNumBasisComponents() + 1;
+    numPartitions = db.getNumBasisPartitions();
+    reset();
+}
+
+void BasisRenderer::delaySource (const HRTFDatabase& db, int source, const float* input, float* left, float* right, int numSamples, int index)
+{
+    auto& s = sources[(size_t) source];
+    constexpr int mask = delayLineSize - 1;
+
+    const int startPos = s.writePos;
+    for (int n = 0; n < numSamples; ++n)
+        s.delayLine[(size_t) ((startPos + n) & mask)] = input[n];
+    s.writePos = (startPos + numSamples) & mask;
+
+    int newDelays[2] = { s.delays[0], s.delays[1] };
+    if (index != s.delayIndex && index >= 0)
+        for (int ear = 0; ear < 2; ++ear)
+            newDelays[ear] = juce::jmin (db.getBasisDelay (index, ear), maxKernelLength);
+
+    float* outs[2] = { left, right };
+
+    for (int ear = 0; ear < 2; ++ear)
+    {
+        float* out = outs[ear];
+        const int oldDelay = s.delays[ear], newDelay = newDelays[ear];
+
+        if (oldDelay == newDelay)
+        {
+            for (int n = 0; n < numSamples; ++n)
+                out[n] = s.delayLine[(size_t) ((startPos + n - newDelay) & mask)];
+        }
+        else
+        {
+            // onsets jump by whole samples, fade between the two taps instead of clicking
+            for (int n = 0; n < numSamples; ++n)
+            {
+                const float t = ((float) n + 0.5f) / (float) numSamples;
+                const float a = s.delayLine[(size_t) ((startPos + n - oldDelay) & mask)];
+                const float b = s.delayLine[(size_t) ((startPos + n - newDelay) & mask)];
+                out[n] = a + t * (b - a);
+            }
+        }
+    }
+
+    s.delays[0] = newDelays[0];
+    s.delays[1] = newDelays[1];
+    s.delayIndex = index;
+}
+
+void BasisRenderer::mixSource (const HRTFDatabase& db, int source, const float* left, const float* right, int start, int numSamples, int index)
+{
+    jassert (start + numSamples <= blockSize);
+
+    if (numChannels == 0)
+        return;
+
+    auto& s = sources[(size_t) source];
+    const float* ears[2] = { left, right };
+
+    if (index == s.weightIndex)
+    {
+        for (int c = 0; c < numChannels; ++c)
+        {
+            const float w = s.weights[(size_t) c];
+            if (w == 0.0f)
+                continue;
+
+            for (int ear = 0; ear < 2; ++ear)
+                juce::FloatVectorOperations::addWithMultiply (frame (c * 2 + ear) + blockSize + start, ears[ear], w, numSamples);
+        }
+
+        return;
+    }
+
+    // a new direction: ramp every weight over this call, a silent source (index -1) ramps to nothing
+    const float* target = index >= 0 ? db.getBasisWeights (index) : nullptr;
+
+    for (int c = 0; c < numChannels; ++c)
+    {
+        const float from = s.weights[(size_t) c];
+        const float to = target != nullptr ? target[c] : 0.0f;
+        s.weights[(size_t) c] = to;
+
+        if (from == 0.0f && to == 0.0f)
+            continue;
+
+        for (int ear = 0; ear < 2; ++ear)
+        {
+            float* dst = frame (c * 2 + ear) + blockSize + start;
+            const float* src = ears[ear];
+
+            for (int n = 0; n < numSamples; ++n)
+                dst[n] += src[n] * (from + (to - from) * ((float) n + 0.5f) / (float) numSamples);
+        }
+    }
+
+    s.weightIndex = index;
+}
+
+void BasisRenderer::process (float* outL, float* outR)
+{
+    if (numChannels == 0)
+    {
+        juce::FloatVectorOperations::clear (outL, blockSize);
+        juce::FloatVectorOperations::clear (outR, blockSize);
+        return;
+    }
+
+    fdlHead = (fdlHead + 1) % maxPartitions;
+
+    // one transform per basis channel, however many sources were mixed into it
+    for (int ch = 0; ch < numChannels * 2; ++ch)
+    {
+        float* f = frame (ch);
+        transform.forward (f, fftSize, delayLineSlot (ch, fdlHead));
+
+        std::copy (f + blockSize, f + fftSize, f);
+        std::fill (f + blockSize, f + fftSize, 0.0f);
+    }
+
+    float* outs[2] = { outL, outR };
+
+    for (int ear = 0; ear < 2; ++ear)
+    {
+        std::fill (acc, acc + 2 * binStride, 0.0f);
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            const int ch = c * 2 + ear;
+            for (int p = 0; p < numPartitions; ++p)
+                PartitionedConvolver::complexMultiplyAccumulate (delayLineSlot (ch, fdlHead - p), filterSpectrum (ch, p), acc, binStride);
+        }
+
+        transform.inverse (acc, outs[ear], 0, blockSize);
+    }
+}
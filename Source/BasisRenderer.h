@@ -0,0 +1,76 @@
+#pragma once
+#include <JuceHeader.h>
+#include "HRTFDatabase.h"
+#include "PartitionedConvolver.h"
+
+// Rendering in the principal-component domain of the HRIR set (see HRTFDatabase::buildBasis).
+// Every source is delayed by its direction's onsets and then only weighted into K + 1 shared basis
+// channels per ear; each channel is convolved once with its basis filter, so the convolution cost
+// follows K and not the number of sources, and moving a source just ramps its weights.
+// Same engine as VirtualSpeakerRenderer: one forward FFT per channel, the products summed in the
+// spectral domain, one inverse FFT per ear. Works on blocks of HRTFDatabase::basisPartitionSize, the size
+// the database transforms its basis filters for, so taking on a new set transforms nothing.
+class BasisRenderer
+{
+public:
+    static constexpr int maxSources = 16; // the speaker renderer's channels
+    static constexpr int maxKernelLength = 1024; // longer IRs are truncated (SADIE goes up to 512)
+
+    void prepare (int blockSize);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const { set.add (storage.data(), storage.size() * sizeof (float)); }
+
+    // Uses db's basis spectra from here on, or switches the renderer off if it has none (or the block size
+    // isn't the one they were made for). Only pointers change, fine for the audio thread; db has to outlive
+    // every process() until the next call. Call again whenever the database changes.
+    void setBasis (const HRTFDatabase& db);
+    bool isActive() const noexcept { return numChannels > 0; }
+
+    // Both ear signals of a source, delayed by the onsets of IR `index` (-1 = silence).
+    // left / right may be the input itself; a delay change is crossfaded over the call.
+    void delaySource (const HRTFDatabase& db, int source, const float* input, float* left, float* right, int numSamples, int index);
+
+    // Weights the (delayed) ear signals into the basis channels at `start` of the current block,
+    // ramping from the last call's weights when the index changed.
+    void mixSource (const HRTFDatabase& db, int source, const float* left, const float* right, int start, int numSamples, int index);
+
+    // One block: convolves everything mixed since the last call, both ears out (overwritten).
+    void process (float* outL, float* outR);
+
+private:
+    static constexpr int maxChannels = (HRTFDatabase::maxBasisComponents + 1) * 2;
+    static constexpr int delayLineSize = 2048; // > maxKernelLength + any block
+    static constexpr int weightCount = HRTFDatabase::maxBasisComponents + 1;
+
+    struct Source
+    {
+        std::array<float, delayLineSize> delayLine {};
+        int writePos = 0;
+        int delayIndex = -1, delays[2] = {};
+
+        int weightIndex = -1;
+        std::array<float, weightCount> weights {};
+    };
+
+    // channel = component * 2 + ear, the database's layout
+    float* spectrum (float* base, int index) const noexcept { return base + (size_t) index * 2 * (size_t) binStride; }
+    const float* filterSpectrum (int channel, int partition) const noexcept { return filters + ((size_t) channel * (size_t) numPartitions + (size_t) partition) * 2 * (size_t) binStride; }
+    float* delayLineSlot (int channel, int index) const noexcept { return spectrum (fdl, channel * maxPartitions + (index + maxPartitions) % maxPartitions); }
+    float* frame (int channel) const noexcept { return frames + (size_t) channel * (size_t) fftSize; }
+
+    int blockSize = 0, fftSize = 0, binStride = 0, maxPartitions = 0;
+    int numChannels = 0, numPartitions = 0; // numChannels = K + 1 per ear
+    PartitionedConvolver::Transform transform;
+
+    std::vector<float> storage;
+    const float* filters = nullptr; // [channel][partition] spectra, the database's
+    float* fdl = nullptr;        // [channel][partition] input spectra
+    float* frames = nullptr;     // [channel] previous block, then the one being mixed
+    float* fftBuffer = nullptr;
+    float* acc = nullptr;
+
+    std::array<Source, maxSources> sources;
+    int fdlHead = 0;
+};
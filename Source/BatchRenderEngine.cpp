@@ -0,0 +1,453 @@
+#include "BatchRenderEngine.h"
+#include "HRTFDatabase.h"
+#include "PartitionedConvolver.h"
+#include "RealtimeSafety.h"
+
+namespace {
+    constexpr size_t alignment = 64;
+    static_assert (BatchRenderEngine::binStride >= BatchRenderEngine::quantum + 1 && BatchRenderEngine::binStride % 16 == 0, "");
+
+    // zero-padded real FFT of len samples, keeps the non-negative half, split into re / im
+    static void forwardTransform (juce::dsp::FFT& fft, float* work, const float* src, int len, float* dst) {
+        std::fill (work, work + 2 * BatchRenderEngine::fftSize, 0.0f);
+        std::copy (src, src + len, work);
+        fft.performRealOnlyForwardTransform (work, true);
+
+        float* im = dst + BatchRenderEngine::binStride;
+        for (int k = 0; k <= BatchRenderEngine::quantum; ++k) {
+            dst[k] = work[2 * k];
+            im[k]  = work[2 * k + 1];
+        }
+    }
+
+    // overlap-save: only the second half of the circular result is valid
+    static void inverseTransform (juce::dsp::FFT& fft, float* work, const float* spectrum, float* dst) {
+        const float* im = spectrum + BatchRenderEngine::binStride;
+        for (int k = 0; k <= BatchRenderEngine::quantum; ++k) {
+            work[2 * k]     = spectrum[k];
+            work[2 * k + 1] = im[k];
+        }
+
+        std::fill (work + 2 * (BatchRenderEngine::quantum + 1), work + 2 * BatchRenderEngine::fftSize, 0.0f);
+        fft.performRealOnlyInverseTransform (work);
+        std::copy (work + BatchRenderEngine::quantum, work + BatchRenderEngine::fftSize, dst);
+    }
+}
+
+BatchRenderEngine::BatchRenderEngine()
+    : juce::Thread ("Panner batch engine"),
+      work ((size_t) (2 * fftSize))
+{
+    startThread (juce::Thread::Priority::high);
+}
+
+BatchRenderEngine::~BatchRenderEngine()
+{
+    stopThread (1000);
+}
+
+void BatchRenderEngine::addVoice (Voice* v)
+{
+    RealtimeSafetyChecker::assertNotAudioThread ("BatchRenderEngine::addVoice (voiceLock)");
+
+    const juce::ScopedLock sl (voiceLock);
+    voices.add (v);
+}
+
+void BatchRenderEngine::removeVoice (Voice* v)
+{
+    // waits for a batch in flight, so the worker can't be holding v afterwards
+    RealtimeSafetyChecker::assertNotAudioThread ("BatchRenderEngine::removeVoice (voiceLock)");
+    const juce::ScopedLock sl (voiceLock);
+    voices.removeFirstMatchingValue (v);
+}
+
+void BatchRenderEngine::voiceEnabledChanged (bool isNowEnabled)
+{
+    numEnabled += isNowEnabled ? 1 : -1;
+    notify();
+}
+
+void BatchRenderEngine::run()
+{
+    while (!threadShouldExit())
+    {
+        // nobody opted in, sleep until someone does
+        if (numEnabled.load() == 0)
+        {
+            wait (-1);
+            continue;
+        }
+
+        bool didWork = false;
+
+        {
+            const juce::ScopedLock sl (voiceLock);
+            int numInBatch = 0;
+
+            for (auto* v : voices)
+            {
+                if (!v->enabled)
+                    continue;
+
+                int expected = Voice::pending;
+                if (!v->state.compare_exchange_strong (expected, Voice::claimed, std::memory_order_acq_rel))
+                    continue;
+
+                batch[(size_t) numInBatch++] = v;
+
+                if (numInBatch == maxBatchSize)
+                {
+                    render (batch.data(), numInBatch, fft, work.data());
+                    numInBatch = 0;
+                    didWork = true;
+                }
+            }
+
+            if (numInBatch > 0)
+            {
+                render (batch.data(), numInBatch, fft, work.data());
+                didWork = true;
+            }
+        }
+
+        // a quantum is ~3 ms, polling at 1 ms leaves most of it for the batch; the audio
+        // threads never have to signal us (and so never touch a lock)
+        if (!didWork)
+            wait (1);
+    }
+}
+
+void BatchRenderEngine::render (Voice* const* jobs, int numVoices, juce::dsp::FFT& fftToUse, float* workBuffer)
+{
+    // 1. the new input frames into each voice's frequency-domain delay line; after a late worker
+    //    a job carries every quantum that was held back, only the newest one's output is kept
+    for (int i = 0; i < numVoices; ++i)
+    {
+        auto& v = *jobs[i];
+
+        for (int f = 0; f < v.jobFrames; ++f)
+        {
+            std::copy (v.frame.begin() + quantum, v.frame.end(), v.frame.begin());
+            std::copy (v.jobInput.begin() + f * quantum, v.jobInput.begin() + (f + 1) * quantum, v.frame.begin() + quantum);
+
+            v.fdlHead = (v.fdlHead + 1) % maxPartitions;
+            forwardTransform (fftToUse, workBuffer, v.frame.data(), fftSize, v.fdlSlot (v.fdlHead));
+        }
+    }
+
+    // 2. spectra of new kernels, the old ones are kept for one quantum to crossfade from
+    for (int i = 0; i < numVoices; ++i)
+    {
+        auto& v = *jobs[i];
+        if (!v.kernelChanged)
+            continue;
+
+        std::swap (v.spectraL, v.previousSpectraL);
+        std::swap (v.spectraR, v.previousSpectraR);
+        v.previousNumPartitions = v.numPartitions;
+        v.numPartitions = (v.kernelLength + quantum - 1) / quantum;
+
+        for (int p = 0; p < v.numPartitions; ++p)
+        {
+            const int len = juce::jmin (quantum, v.kernelLength - p * quantum);
+            forwardTransform (fftToUse, workBuffer, v.kernelL.data() + p * quantum, len, v.spectraL + (size_t) p * spectrumSize);
+            forwardTransform (fftToUse, workBuffer, v.kernelR.data() + p * quantum, len, v.spectraR + (size_t) p * spectrumSize);
+        }
+    }
+
+    // 3. multiply-add every partition against the delay line, the whole batch in one sweep on SIMD
+    //    registers; each delay line slot is read once for both ears
+    auto accumulate = [] (const Voice& v, const float* left, const float* right, int partitions, float* outL, float* outR)
+    {
+        std::fill (outL, outL + spectrumSize, 0.0f);
+        std::fill (outR, outR + spectrumSize, 0.0f);
+
+        for (int p = 0; p < partitions; ++p)
+        {
+            const float* slot = v.fdlSlot (v.fdlHead - p);
+            PartitionedConvolver::complexMultiplyAccumulate (slot, left + (size_t) p * spectrumSize, outL, binStride);
+            PartitionedConvolver::complexMultiplyAccumulate (slot, right + (size_t) p * spectrumSize, outR, binStride);
+        }
+    };
+
+    for (int i = 0; i < numVoices; ++i)
+    {
+        auto& v = *jobs[i];
+        accumulate (v, v.spectraL, v.spectraR, v.numPartitions, v.accL, v.accR);
+
+        if (v.kernelChanged)
+            accumulate (v, v.previousSpectraL, v.previousSpectraR, v.previousNumPartitions, v.previousAccL, v.previousAccR);
+    }
+
+    // 4. back to the time domain
+    for (int i = 0; i < numVoices; ++i)
+    {
+        auto& v = *jobs[i];
+        inverseTransform (fftToUse, workBuffer, v.accL, v.jobOutL.data());
+        inverseTransform (fftToUse, workBuffer, v.accR, v.jobOutR.data());
+
+        if (v.kernelChanged)
+        {
+            std::array<float, quantum> oldL, oldR;
+            inverseTransform (fftToUse, workBuffer, v.previousAccL, oldL.data());
+            inverseTransform (fftToUse, workBuffer, v.previousAccR, oldR.data());
+
+            for (int s = 0; s < quantum; ++s)
+            {
+                const float t = ((float) s + 0.5f) / (float) quantum;
+                v.jobOutL[(size_t) s] = oldL[(size_t) s] + t * (v.jobOutL[(size_t) s] - oldL[(size_t) s]);
+                v.jobOutR[(size_t) s] = oldR[(size_t) s] + t * (v.jobOutR[(size_t) s] - oldR[(size_t) s]);
+            }
+
+            v.kernelChanged = false;
+        }
+
+        v.state.store (Voice::done, std::memory_order_release);
+    }
+}
+
+//==============================================================================
+BatchRenderEngine::Voice::Voice()
+    : stagedL ((size_t) maxKernelLength), stagedR ((size_t) maxKernelLength),
+      kernelL ((size_t) maxKernelLength), kernelR ((size_t) maxKernelLength),
+      work ((size_t) (2 * fftSize))
+{
+    const size_t kernelFloats = (size_t) maxPartitions * spectrumSize;
+    storage.assign (5 * kernelFloats + 4 * (size_t) spectrumSize + alignment / sizeof (float), 0.0f);
+
+    auto* p = reinterpret_cast<float*> ((reinterpret_cast<uintptr_t> (storage.data()) + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    auto carve = [&p] (size_t numFloats) { auto* start = p; p += numFloats; return start; };
+
+    fdl = carve (kernelFloats);
+    spectraL = carve (kernelFloats);
+    spectraR = carve (kernelFloats);
+    previousSpectraL = carve (kernelFloats);
+    previousSpectraR = carve (kernelFloats);
+    accL = carve ((size_t) spectrumSize);
+    accR = carve ((size_t) spectrumSize);
+    previousAccL = carve ((size_t) spectrumSize);
+    previousAccR = carve ((size_t) spectrumSize);
+
+    engine->addVoice (this);
+}
+
+BatchRenderEngine::Voice::~Voice()
+{
+    setEnabled (false);
+    engine->removeVoice (this);
+}
+
+void BatchRenderEngine::Voice::setEnabled (bool shouldBeEnabled)
+{
+    if (enabled == shouldBeEnabled)
+        return;
+
+    RealtimeSafetyChecker::assertNotAudioThread ("BatchRenderEngine::Voice::setEnabled (voiceLock)");
+
+    {
+        const juce::ScopedLock sl (engine->voiceLock);
+        enabled = shouldBeEnabled;
+    }
+
+    engine->voiceEnabledChanged (shouldBeEnabled);
+}
+
+void BatchRenderEngine::Voice::reset()
+{
+    // take back a job the worker hasn't started, there's no point rendering it any more
+    int s = pending;
+    state.compare_exchange_strong (s, idle, std::memory_order_acq_rel);
+
+    inQueue.fill (0.0f);
+    outQueueL.fill (0.0f);
+    outQueueR.fill (0.0f);
+    queuePos = 0;
+    numHeldFrames = 0;
+    historyLost = concealing = false;
+    stagedDirty = false;
+
+    // what the worker is holding is cleared once it hands the job back (see exchange)
+    if (state.load (std::memory_order_acquire) == claimed)
+    {
+        resetPending = resultStale = true;
+        return;
+    }
+
+    clearJob();
+    resetPending = resultStale = false;
+}
+
+void BatchRenderEngine::Voice::clearJob()
+{
+    state.store (idle, std::memory_order_relaxed);
+
+    jobOutL.fill (0.0f);
+    jobOutR.fill (0.0f);
+    frame.fill (0.0f);
+    std::fill (fdl, fdl + (size_t) maxPartitions * spectrumSize, 0.0f);
+
+    // fade the next kernel in from silence
+    kernelLength = numPartitions = previousNumPartitions = 0;
+    kernelChanged = false;
+}
+
+void BatchRenderEngine::Voice::setKernel (const float* left, const float* right, int length)
+{
+    length = juce::jmin (length, maxKernelLength);
+
+    // same level as juce::dsp::Convolution with Normalise::yes, so both paths sit under the same make-up gain
+    const float gain = HRTFDatabase::getKernelGain (left, right, length);
+
+    juce::FloatVectorOperations::multiply (stagedL.data(), left, gain, length);
+    juce::FloatVectorOperations::multiply (stagedR.data(), right, gain, length);
+    stagedLength = length;
+    stagedDirty = true;
+}
+
+void BatchRenderEngine::Voice::process (const float* input, float* outL, float* outR, int numSamples)
+{
+    for (int written = 0; written < numSamples;)
+    {
+        const int chunk = juce::jmin (numSamples - written, quantum - queuePos);
+
+        // input before output, they may be the same memory
+        std::copy (input + written, input + written + chunk, inQueue.begin() + queuePos);
+        std::copy (outQueueL.begin() + queuePos, outQueueL.begin() + queuePos + chunk, outL + written);
+        std::copy (outQueueR.begin() + queuePos, outQueueR.begin() + queuePos + chunk, outR + written);
+
+        queuePos += chunk;
+        written += chunk;
+
+        if (queuePos == quantum)
+        {
+            exchange();
+            queuePos = 0;
+        }
+    }
+}
+
+void BatchRenderEngine::Voice::exchange()
+{
+    holdInput();
+
+    // the worker is still on it: play something plausible now, its result is too late to use
+    if (!collect())
+    {
+        conceal();
+        resultStale = true;
+        return;
+    }
+
+    if (resultStale)
+        conceal();
+    else
+        deliver();
+
+    resultStale = false;
+
+    if (resetPending)
+    {
+        clearJob();
+        resetPending = false;
+    }
+
+    handOver();
+}
+
+bool BatchRenderEngine::Voice::collect()
+{
+    int s = state.load (std::memory_order_acquire);
+
+    // the worker hasn't got to it, do it here rather than wait
+    if (s == pending && state.compare_exchange_strong (s, claimed, std::memory_order_acq_rel))
+    {
+        Voice* self = this;
+        render (&self, 1, fft, work.data());
+        return true;
+    }
+
+    // claimed: the worker is in the middle of a batch, never wait for it
+    return s != claimed;
+}
+
+void BatchRenderEngine::Voice::holdInput()
+{
+    // the worker has been away for longer than a job can carry: start over from silence rather than queue more
+    if (numHeldFrames == maxFramesPerJob)
+    {
+        numHeldFrames = 0;
+        historyLost = true;
+    }
+
+    std::copy (inQueue.begin(), inQueue.end(), heldInput.begin() + numHeldFrames * quantum);
+    ++numHeldFrames;
+}
+
+void BatchRenderEngine::Voice::handOver()
+{
+    if (historyLost)
+    {
+        frame.fill (0.0f);
+        std::fill (fdl, fdl + (size_t) maxPartitions * spectrumSize, 0.0f);
+        historyLost = false;
+    }
+
+    std::copy (heldInput.begin(), heldInput.begin() + numHeldFrames * quantum, jobInput.begin());
+    jobFrames = numHeldFrames;
+    numHeldFrames = 0;
+
+    if (stagedDirty)
+    {
+        std::copy (stagedL.begin(), stagedL.begin() + stagedLength, kernelL.begin());
+        std::copy (stagedR.begin(), stagedR.begin() + stagedLength, kernelR.begin());
+        kernelLength = stagedLength;
+        kernelChanged = true;
+        stagedDirty = false;
+    }
+
+    state.store (pending, std::memory_order_release);
+}
+
+void BatchRenderEngine::Voice::deliver()
+{
+    outQueueL = jobOutL;
+    outQueueR = jobOutR;
+
+    // back from concealing: fade in from the silence it ended in
+    if (concealing)
+    {
+        for (int s = 0; s < quantum; ++s)
+        {
+            const float t = ((float) s + 0.5f) / (float) quantum;
+            outQueueL[(size_t) s] *= t;
+            outQueueR[(size_t) s] *= t;
+        }
+
+        concealing = false;
+    }
+}
+
+void BatchRenderEngine::Voice::conceal()
+{
+    // first late quantum: the last one played backwards, so it joins without a step, faded out;
+    // silence after that until a result is on time again
+    if (concealing)
+    {
+        outQueueL.fill (0.0f);
+        outQueueR.fill (0.0f);
+        return;
+    }
+
+    std::reverse (outQueueL.begin(), outQueueL.end());
+    std::reverse (outQueueR.begin(), outQueueR.end());
+
+    for (int s = 0; s < quantum; ++s)
+    {
+        const float w = 0.5f + 0.5f * std::cos (juce::MathConstants<float>::pi * ((float) s + 0.5f) / (float) quantum);
+        outQueueL[(size_t) s] *= w;
+        outQueueR[(size_t) s] *= w;
+    }
+
+    concealing = true;
+}
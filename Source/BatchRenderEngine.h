@@ -0,0 +1,133 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Opt-in process-wide convolution engine for sessions with lots of panner instances.
+// Instead of every instance running its own small FFTs, each one hands its per-quantum
+// work (one mono source -> two ears) to a shared worker thread. The worker runs the
+// forward FFTs, spectral multiply-adds and inverse FFTs for a whole batch of voices
+// stage by stage, so the FFT tables and code stay hot in cache.
+//
+// Voices work in fixed quanta and are pipelined by one quantum: the result of quantum k
+// is picked up when quantum k+1 is handed over, which gives the worker a whole quantum
+// to get to it. If it hasn't started on it by then, the instance renders the job itself.
+// The audio thread never waits: if the worker is in the middle of it, its result is dropped,
+// the voice plays a faded continuation of the last quantum instead, and the input that
+// couldn't be handed over goes with the next job (see Voice::exchange).
+//
+// Spectra are split-complex and cache-line aligned, multiplied with the convolver's SIMD loop.
+//
+// Latency is two quanta (one to fill, one for the pipeline).
+class BatchRenderEngine : private juce::Thread
+{
+public:
+    static constexpr int quantum = 128;
+    static constexpr int fftOrder = 8;              // 2 * quantum, overlap-save
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int binStride = 144;            // bins 0..quantum, padded to a whole cache line
+    static constexpr int spectrumSize = 2 * binStride; // re, then im
+    static constexpr int maxKernelLength = 1024;     // longer IRs are truncated (SADIE goes up to 512)
+    static constexpr int maxPartitions = maxKernelLength / quantum;
+    static constexpr int latencySamples = 2 * quantum;
+    static constexpr int maxBatchSize = 16;
+    static constexpr int maxFramesPerJob = 4;        // quanta held back while the worker is late
+
+    class Voice;
+
+    BatchRenderEngine();
+    ~BatchRenderEngine() override;
+
+private:
+    void run() override;
+
+    void addVoice (Voice*);
+    void removeVoice (Voice*);
+    void voiceEnabledChanged (bool isNowEnabled);
+
+    // Renders the claimed jobs of a batch of voices, one stage at a time across all of them.
+    static void render (Voice* const* batch, int numVoices, juce::dsp::FFT& fft, float* work);
+
+    juce::CriticalSection voiceLock; // the worker and (un)registering voices, never the audio thread
+    juce::Array<Voice*> voices;
+    std::atomic<int> numEnabled { 0 };
+
+    juce::dsp::FFT fft { fftOrder };
+    std::vector<float> work;
+    std::array<Voice*, maxBatchSize> batch {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchRenderEngine)
+};
+
+// One mono source rendered to two ears through the shared engine.
+// Registers itself with the process-wide engine for as long as it exists.
+class BatchRenderEngine::Voice
+{
+public:
+    Voice();
+    ~Voice();
+
+    // message thread: lets the worker pick this voice's jobs up (otherwise every job is rendered inline)
+    void setEnabled (bool shouldBeEnabled);
+
+    // audio thread -------------------------------------------------------
+    void reset();
+
+    // Takes effect at the next quantum, crossfaded over one quantum.
+    void setKernel (const float* left, const float* right, int length);
+
+    // input may alias outL
+    void process (const float* input, float* outL, float* outR, int numSamples);
+
+private:
+    friend class BatchRenderEngine;
+    enum State { idle, pending, claimed, done };
+
+    void exchange();
+    bool collect();
+    void holdInput();
+    void handOver();
+    void clearJob();
+    void deliver();
+    void conceal();
+    float* fdlSlot (int index) const noexcept { return fdl + (size_t) ((index + maxPartitions) % maxPartitions) * spectrumSize; }
+
+    juce::SharedResourcePointer<BatchRenderEngine> engine;
+    bool enabled = false;
+
+    // audio thread side
+    std::array<float, quantum> inQueue {}, outQueueL {}, outQueueR {};
+    int queuePos = 0;
+    std::vector<float> stagedL, stagedR;
+    int stagedLength = 0;
+    bool stagedDirty = false;
+
+    // input not handed over yet, because the worker still had the job
+    std::array<float, maxFramesPerJob * quantum> heldInput {};
+    int numHeldFrames = 0;
+    bool historyLost = false;  // more was held back than fits, the job starts over from silence
+    bool resultStale = false;  // the job in flight is for a quantum that has been played already
+    bool resetPending = false; // reset() came while the worker had the job
+    bool concealing = false;
+
+    // the job; belongs to whoever set the state last (audio thread: idle / done, worker: claimed)
+    std::atomic<int> state { idle };
+    std::array<float, maxFramesPerJob * quantum> jobInput {};
+    int jobFrames = 0;
+    std::array<float, quantum> jobOutL {}, jobOutR {};
+    std::array<float, fftSize> frame {};
+    std::vector<float> kernelL, kernelR;
+    int kernelLength = 0, numPartitions = 0, previousNumPartitions = 0;
+    bool kernelChanged = false;
+
+    // one aligned block: delay line, both kernel spectra (and the ones faded from), accumulators
+    std::vector<float> storage;
+    float* fdl = nullptr;
+    int fdlHead = 0;
+    float* spectraL = nullptr, * spectraR = nullptr, * previousSpectraL = nullptr, * previousSpectraR = nullptr;
+    float* accL = nullptr, * accR = nullptr, * previousAccL = nullptr, * previousAccR = nullptr;
+
+    // for rendering inline when the worker didn't get to it
+    juce::dsp::FFT fft { fftOrder };
+    std::vector<float> work;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Voice)
+};
@@ -0,0 +1,177 @@
+#include "DistanceEngine.h"
+
+void DistanceEngine::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate;
+
+    // room for the longest propagation delay plus the interpolation tap
+    const int maxDelay = (int) std::ceil (maxDistance / speedOfSound * sampleRate) + 2;
+    delayLine.assign ((size_t) juce::nextPowerOfTwo (maxDelay), 0.0f);
+    delayMask = (int) delayLine.size() - 1;
+
+    // near-field ILD is mostly a low frequency effect, shelve below ~1.5 kHz
+    shelfCoeff = std::exp (-juce::MathConstants<float>::twoPi * 1500.0f / (float) sampleRate);
+
+    reset();
+}
+
+void DistanceEngine::reset()
+{
+    std::fill (delayLine.begin(), delayLine.end(), 0.0f);
+    writePos = 0;
+
+    currentGain = distanceGain (referenceDistance);
+    airCoeff = airCoefficient (referenceDistance);
+    airState = 0.0f;
+    currentDelay = 0.0f;
+    snapDelay = true;
+
+    shelfStateL = shelfStateR = 0.0f;
+    currentShelfGainL = currentShelfGainR = 1.0f;
+}
+
+void DistanceEngine::setDirection (float azimuthDeg, float elevationDeg)
+{
+    lateral = std::sin (juce::degreesToRadians (azimuthDeg)) * std::cos (juce::degreesToRadians (elevationDeg));
+}
+
+void DistanceEngine::setPropagationDelayEnabled (bool shouldBeEnabled)
+{
+    if (delayEnabled == shouldBeEnabled)
+        return;
+
+    // jump straight to the new delay rather than gliding (which would be a huge pitch bend)
+    delayEnabled = shouldBeEnabled;
+    snapDelay = true;
+}
+
+float DistanceEngine::distanceGain (float distance) const noexcept
+{
+    return referenceDistance / juce::jmax (minDistance, distance);
+}
+
+float DistanceEngine::airCoefficient (float distance) const noexcept
+{
+    // roughly 0.15 dB/m at 10 kHz (ISO 9613-1, 20 degC, 50% RH), matched with a one-pole low-pass
+    const float attenuationDb = 0.15f * distance;
+    const float ratio = std::pow (10.0f, attenuationDb / 10.0f) - 1.0f;
+    const float nyquistLimit = 0.45f * (float) sampleRate;
+
+    const float cutoff = ratio > 1.0e-6f ? juce::jmin (nyquistLimit, 10000.0f / std::sqrt (ratio)) : nyquistLimit;
+    if (cutoff >= nyquistLimit)
+        return 0.0f;
+
+    return std::exp (-juce::MathConstants<float>::twoPi * cutoff / (float) sampleRate);
+}
+
+float DistanceEngine::delayInSamples (float distance) const noexcept
+{
+    return juce::jlimit (minDistance, maxDistance, distance) / speedOfSound * (float) sampleRate;
+}
+
+int DistanceEngine::getTailLengthSamples (float distance) const noexcept
+{
+    const float delay = delayEnabled ? juce::jmax (currentDelay, delayInSamples (distance)) : 0.0f;
+    return (int) std::ceil (delay) + controlBlockSize + (int) (0.005 * sampleRate);
+}
+
+float DistanceEngine::nearFieldILDdB (float distance) const noexcept
+{
+    if (distance >= referenceDistance)
+        return 0.0f;
+
+    // grows by ~6 dB per halving of distance for a fully lateral source
+    const float ild = 6.0f * std::abs (lateral) * std::log2 (referenceDistance / juce::jmax (minDistance, distance));
+    return juce::jlimit (0.0f, 15.0f, ild);
+}
+
+void DistanceEngine::processInput (float* samples, int numSamples, float startDistance, float endDistance)
+{
+    for (int start = 0; start < numSamples; start += controlBlockSize)
+    {
+        const int len = juce::jmin (controlBlockSize, numSamples - start);
+        const float d = startDistance + (endDistance - startDistance) * (float) (start + len) / (float) numSamples;
+
+        airCoeff = airCoefficient (d);
+        const float gainStep = (distanceGain (d) - currentGain) / (float) len;
+        const float targetDelay = delayEnabled ? delayInSamples (d) : 0.0f;
+        if (std::exchange (snapDelay, false))
+            currentDelay = targetDelay;
+        const float delayStep = (targetDelay - currentDelay) / (float) len;
+
+        auto* x = samples + start;
+
+        for (int s = 0; s < len; ++s)
+        {
+            float in = x[s];
+
+            // always keep the line filled so switching the delay on never replays stale audio
+            delayLine[(size_t) writePos] = in;
+
+            if (delayEnabled)
+            {
+                const float readPos = (float) writePos - currentDelay;
+                const float base = std::floor (readPos);
+                const float frac = readPos - base;
+                const int i0 = (int) base & delayMask;
+                const int i1 = (i0 + 1) & delayMask;
+                in = delayLine[(size_t) i0] + frac * (delayLine[(size_t) i1] - delayLine[(size_t) i0]);
+
+                currentDelay += delayStep;
+            }
+
+            writePos = (writePos + 1) & delayMask;
+
+            airState = in + airCoeff * (airState - in);
+
+            currentGain += gainStep;
+            x[s] = airState * currentGain;
+        }
+    }
+}
+
+void DistanceEngine::processEars (float* left, float* right, int numSamples, float startDistance, float endDistance)
+{
+    for (int start = 0; start < numSamples; start += controlBlockSize)
+    {
+        const int len = juce::jmin (controlBlockSize, numSamples - start);
+        const float d = startDistance + (endDistance - startDistance) * (float) (start + len) / (float) numSamples;
+
+        // near ear gets half the ILD as a boost, far ear the other half as a cut
+        const float halfIld = 0.5f * nearFieldILDdB (d);
+        const float nearGain = juce::Decibels::decibelsToGain (halfIld);
+        const float farGain  = juce::Decibels::decibelsToGain (-halfIld);
+
+        const float targetL = lateral >= 0.0f ? nearGain : farGain;
+        const float targetR = lateral >= 0.0f ? farGain  : nearGain;
+        const float stepL = (targetL - currentShelfGainL) / (float) len;
+        const float stepR = (targetR - currentShelfGainR) / (float) len;
+
+        // nothing to do at or beyond the reference radius
+        if (halfIld == 0.0f && currentShelfGainL == 1.0f && currentShelfGainR == 1.0f)
+        {
+            shelfStateL = shelfStateR = 0.0f;
+            continue;
+        }
+
+        auto* l = left + start;
+        auto* r = right + start;
+
+        for (int s = 0; s < len; ++s)
+        {
+            // low shelf: y = x + (G - 1) * lowpass(x)
+            shelfStateL = l[s] + shelfCoeff * (shelfStateL - l[s]);
+            shelfStateR = r[s] + shelfCoeff * (shelfStateR - r[s]);
+
+            currentShelfGainL += stepL;
+            currentShelfGainR += stepR;
+
+            l[s] += (currentShelfGainL - 1.0f) * shelfStateL;
+            r[s] += (currentShelfGainR - 1.0f) * shelfStateR;
+        }
+
+        // snap away float drift so the bypass check above can trigger again
+        if (halfIld == 0.0f)
+            currentShelfGainL = currentShelfGainR = 1.0f;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <JuceHeader.h>
+#include "MemoryLock.h"
+
+// Distance cues for one virtual source, all with cheap recursive filters:
+//  - inverse-distance gain (relative to the SADIE measurement radius)
+//  - air absorption as a one-pole low-pass whose cutoff drops with distance
+//  - optional fractional propagation delay (moving the distance gives Doppler)
+//  - near-field ILD: low shelves boosting the near ear / cutting the far ear
+// Coefficients are recomputed every controlBlockSize samples and ramped in between.
+class DistanceEngine
+{
+public:
+    static constexpr float referenceDistance = 1.2f; // SADIE II measurement radius (m)
+    static constexpr float minDistance = 0.2f;
+    static constexpr float maxDistance = 50.0f;
+    static constexpr float speedOfSound = 343.0f;
+    static constexpr int controlBlockSize = 32;
+
+    void prepare (double sampleRate);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const { set.add (delayLine.data(), delayLine.size() * sizeof (float)); }
+
+    void setDirection (float azimuthDeg, float elevationDeg);
+    void setPropagationDelayEnabled (bool shouldBeEnabled);
+
+    // mono source signal, before the HRIR convolution
+    void processInput (float* samples, int numSamples, float startDistance, float endDistance);
+
+    // the two ear signals of this source, after the HRIR convolution
+    void processEars (float* left, float* right, int numSamples, float startDistance, float endDistance);
+
+    // how long the output keeps going after the input stops: the propagation delay plus the filters settling
+    int getTailLengthSamples (float distance) const noexcept;
+
+private:
+    float distanceGain (float distance) const noexcept;
+    float airCoefficient (float distance) const noexcept;
+    float delayInSamples (float distance) const noexcept;
+    float nearFieldILDdB (float distance) const noexcept;
+
+    double sampleRate = 44100.0;
+    float lateral = 0.0f; // +1 = fully left, -1 = fully right
+    bool delayEnabled = false;
+
+    // input stage
+    float currentGain = 1.0f;
+    float airCoeff = 0.0f, airState = 0.0f;
+    float currentDelay = 0.0f;
+    bool snapDelay = true;
+    std::vector<float> delayLine;
+    int delayMask = 0, writePos = 0;
+
+    // ear stage
+    float shelfCoeff = 0.0f;
+    float shelfStateL = 0.0f, shelfStateR = 0.0f;
+    float currentShelfGainL = 1.0f, currentShelfGainR = 1.0f;
+};
@@ -0,0 +1,1164 @@
+#include "HRTFDatabase.h"
+#include "RealtimeSafety.h"
+#include <future>
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+namespace {
+    static inline float wrap360 (float a) {
+        while (a < 0.0f) a += 360.0f;
+        while (a >= 360.0f) a -= 360.0f;
+        return a;
+    }
+
+    // SADIE names use a decimal comma: "azi_22,5_ele_-17,5"
+    static inline float parseAngle (const juce::String& s) {
+        return s.replaceCharacter (',', '.').getFloatValue();
+    }
+
+    static float* allocateAligned (size_t numFloats) {
+        auto* p = static_cast<float*> (::operator new (numFloats * sizeof (float), std::align_val_t (HRTFDatabase::alignment)));
+        std::fill (p, p + numFloats, 0.0f);
+        return p;
+    }
+
+    static void freeAligned (float* p) {
+        if (p != nullptr)
+            ::operator delete (p, std::align_val_t (HRTFDatabase::alignment));
+    }
+
+    // first sample within 20 dB of the peak: where the direct sound arrives
+    static int findOnset (const float* ir, int length) noexcept {
+        float peak = 0.0f;
+        for (int n = 0; n < length; ++n)
+            peak = juce::jmax (peak, std::abs (ir[n]));
+
+        int onset = 0;
+        while (onset < length && std::abs (ir[onset]) < 0.1f * peak)
+            ++onset;
+        return onset;
+    }
+
+    // dst[i] = src[i] * scale, n a multiple of 8 and src 16-byte aligned
+    static void widen (const int16_t* src, float* dst, float scale, int n) noexcept {
+       #if JUCE_USE_SSE_INTRINSICS
+        const auto s = _mm_set1_ps (scale);
+        for (int i = 0; i < n; i += 8) {
+            const auto x = _mm_load_si128 (reinterpret_cast<const __m128i*> (src + i));
+            const auto lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (x, x), 16);
+            const auto hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (x, x), 16);
+            _mm_storeu_ps (dst + i,     _mm_mul_ps (_mm_cvtepi32_ps (lo), s));
+            _mm_storeu_ps (dst + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (hi), s));
+        }
+       #elif JUCE_USE_ARM_NEON
+        for (int i = 0; i < n; i += 8) {
+            const int16x8_t x = vld1q_s16 (src + i);
+            vst1q_f32 (dst + i,     vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (x))), scale));
+            vst1q_f32 (dst + i + 4, vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (x))), scale));
+        }
+       #else
+        for (int i = 0; i < n; ++i)
+            dst[i] = (float) src[i] * scale;
+       #endif
+    }
+
+    // FNV-1a, 64 bit
+    static juce::uint64 hashBytes (const void* data, size_t numBytes, juce::uint64 h = 14695981039346656037ull) {
+        auto* bytes = static_cast<const uint8_t*> (data);
+        for (size_t i = 0; i < numBytes; ++i)
+            h = (h ^ bytes[i]) * 1099511628211ull;
+        return h;
+    }
+
+    using Complex = std::complex<float>;
+
+    // Eigen decomposition of a small symmetric n x n matrix (row-major), cyclic Jacobi.
+    // a ends up diagonal (the eigenvalues), the columns of v are the eigenvectors.
+    static void jacobiEigen (std::vector<double>& a, std::vector<double>& v, int n) {
+        v.assign ((size_t) (n * n), 0.0);
+        for (int i = 0; i < n; ++i)
+            v[(size_t) (i * n + i)] = 1.0;
+
+        auto at = [n] (std::vector<double>& m, int r, int c) -> double& { return m[(size_t) (r * n + c)]; };
+
+        for (int sweep = 0; sweep < 50; ++sweep) {
+            double offDiagonal = 0.0;
+            for (int p = 0; p < n; ++p)
+                for (int q = p + 1; q < n; ++q)
+                    offDiagonal += at (a, p, q) * at (a, p, q);
+
+            if (offDiagonal < 1.0e-20)
+                return;
+
+            for (int p = 0; p < n; ++p) {
+                for (int q = p + 1; q < n; ++q) {
+                    if (std::abs (at (a, p, q)) < 1.0e-300)
+                        continue;
+
+                    const double theta = (at (a, q, q) - at (a, p, p)) / (2.0 * at (a, p, q));
+                    const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs (theta) + std::sqrt (theta * theta + 1.0));
+                    const double c = 1.0 / std::sqrt (t * t + 1.0), s = t * c;
+
+                    for (int k = 0; k < n; ++k) {
+                        const double akp = at (a, k, p), akq = at (a, k, q);
+                        at (a, k, p) = c * akp - s * akq;
+                        at (a, k, q) = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < n; ++k) {
+                        const double apk = at (a, p, k), aqk = at (a, q, k);
+                        at (a, p, k) = c * apk - s * aqk;
+                        at (a, q, k) = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < n; ++k) {
+                        const double vkp = at (v, k, p), vkq = at (v, k, q);
+                        at (v, k, p) = c * vkp - s * vkq;
+                        at (v, k, q) = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+    }
+
+    // The helper threads for parallelFor. Shared: it lives while any load holds one (loadShared and
+    // loadFromFolder do, for their whole run), so a load starts its threads once, not once per step.
+    struct LoadWorkers {
+        juce::ThreadPool pool { juce::jmax (1, juce::SystemStats::getNumCpus() - 1) };
+    };
+
+    // Runs body(begin, end) over fixed-size chunks of [0, numItems) on all cores, calling thread included.
+    // Chunk boundaries don't depend on the number of threads, so anything computed per chunk
+    // (and combined in chunk order afterwards) gives the same result on every machine.
+    static void parallelFor (int numItems, int chunkSize, const std::function<void (int, int)>& body) {
+        const int numChunks = (numItems + chunkSize - 1) / chunkSize;
+        const int numThreads = juce::jlimit (1, juce::jmax (1, numChunks), juce::SystemStats::getNumCpus());
+
+        std::atomic<int> nextChunk { 0 };
+        auto work = [&] {
+            for (int c = nextChunk++; c < numChunks; c = nextChunk++)
+                body (c * chunkSize, juce::jmin (numItems, (c + 1) * chunkSize));
+        };
+
+        if (numThreads == 1) {
+            work();
+            return;
+        }
+
+        const juce::SharedResourcePointer<LoadWorkers> workers;
+        std::atomic<int> running { numThreads - 1 };
+        juce::WaitableEvent allDone;
+
+        // concurrent loads queue up on the same threads; each call only waits for its own jobs
+        for (int t = 0; t < numThreads - 1; ++t)
+            workers->pool.addJob ([&] {
+                work();
+                if (--running == 0)
+                    allDone.signal();
+                return juce::ThreadPoolJob::jobHasFinished;
+            });
+
+        work();
+        allDone.wait();
+    }
+
+    // zero-padded forward FFT of a real signal, one per worker
+    struct SpectrumScratch {
+        explicit SpectrumScratch (int order) : fft (order), timeDomain ((size_t) fft.getSize()), spectrum ((size_t) fft.getSize()) {}
+
+        void forward (const float* data, int len) {
+            std::fill (timeDomain.begin(), timeDomain.end(), Complex());
+            for (int i = 0; i < len; ++i)
+                timeDomain[(size_t) i] = data[i];
+            fft.perform (timeDomain.data(), spectrum.data(), false);
+        }
+
+        juce::dsp::FFT fft;
+        std::vector<Complex> timeDomain, spectrum;
+    };
+
+    // Minimum phase spectrum with the given magnitude (bins 0..n/2), via the folded real cepstrum.
+    static void makeMinimumPhase (juce::dsp::FFT& fft, const std::vector<float>& magnitude, std::vector<Complex>& out) {
+        const int n = fft.getSize();
+        std::vector<Complex> logMag ((size_t) n), cepstrum ((size_t) n);
+
+        for (int k = 0; k <= n / 2; ++k)
+        {
+            logMag[(size_t) k] = std::log (std::max (magnitude[(size_t) k], 1.0e-9f));
+            if (k > 0 && k < n / 2)
+                logMag[(size_t) (n - k)] = logMag[(size_t) k];
+        }
+
+        fft.perform (logMag.data(), cepstrum.data(), true);
+
+        for (int k = 0; k < n; ++k)
+        {
+            const float c = cepstrum[(size_t) k].real();
+            if (k == 0 || k == n / 2) cepstrum[(size_t) k] = c;
+            else if (k < n / 2)       cepstrum[(size_t) k] = 2.0f * c;
+            else                      cepstrum[(size_t) k] = 0.0f;
+        }
+
+        fft.perform (cepstrum.data(), logMag.data(), false);
+
+        out.resize ((size_t) n);
+        for (int k = 0; k < n; ++k)
+            out[(size_t) k] = std::exp (logMag[(size_t) k]);
+    }
+}
+
+HRTFDatabase::~HRTFDatabase()
+{
+    freeAligned (arena);
+    freeAligned (directions);
+    freeAligned (basisSpectra);
+
+    if (compactArena != nullptr)
+        ::operator delete (compactArena, std::align_val_t (alignment));
+}
+
+std::shared_ptr<const HRTFDatabase> HRTFDatabase::loadShared (const juce::File& subjectRoot, double sr,
+                                                              const Equalisation& equalisation, int basisComponents,
+                                                              SampleFormat format, bool levelsOfDetail)
+{
+    RealtimeSafetyChecker::assertNotAudioThread ("HRTFDatabase::loadShared (lock + file loading)");
+    const juce::SharedResourcePointer<LoadWorkers> workers;
+
+    // One entry per folder / rate / settings. While the first instance asking decodes it, the others wait on
+    // its future; the lock is only held to look an entry up or fill it in, so loads of different sets run side by side.
+    using Future = std::shared_future<std::shared_ptr<const HRTFDatabase>>;
+    struct Entry { std::weak_ptr<const HRTFDatabase> db; Future loading; };
+
+    static juce::CriticalSection cacheLock;
+    static std::map<juce::String, Entry> cache;
+
+    const auto& hp = equalisation.headphoneFilter;
+    const auto key = subjectRoot.getFullPathName() + "|" + juce::String (sr) + "|" + (equalisation.diffuseField ? "df" : "")
+                   + "|" + hp.getFullPathName() + "|" + juce::String (hp.getLastModificationTime().toMilliseconds())
+                   + "|" + juce::String (basisComponents) + (format == SampleFormat::int16 ? "|16" : "") + (levelsOfDetail ? "|lod" : "");
+
+    std::promise<std::shared_ptr<const HRTFDatabase>> promise;
+    Future pending;
+
+    {
+        const juce::ScopedLock sl (cacheLock);
+
+        for (auto it = cache.begin(); it != cache.end();)
+            it = it->second.db.expired() && !it->second.loading.valid() ? cache.erase (it) : std::next (it);
+
+        auto& entry = cache[key];
+        if (auto existing = entry.db.lock())
+            return existing;
+
+        if (entry.loading.valid())
+            pending = entry.loading;
+        else
+            entry.loading = promise.get_future().share();
+    }
+
+    // someone else is decoding this one
+    if (pending.valid())
+        return pending.get();
+
+    std::shared_ptr<HRTFDatabase> db = loadFromFolder (subjectRoot, sr, equalisation);
+    if (db != nullptr)
+    {
+        db->buildDirectionTable();
+        if (basisComponents > 0)
+            db->buildBasis (basisComponents);
+        if (levelsOfDetail)
+            db->buildLevelsOfDetail();
+        if (basisComponents > 0)
+            db->keepOnlyBasis();
+        if (format == SampleFormat::int16)
+            db->convertTo16Bit();
+    }
+
+    {
+        // a failed load leaves nothing behind, the next request tries again
+        const juce::ScopedLock sl (cacheLock);
+        auto& entry = cache[key];
+        entry.db = db;
+        entry.loading = {};
+    }
+
+    promise.set_value (db);
+    return db;
+}
+
+juce::String HRTFDatabase::getSubfolderNameForSampleRate (double sr)
+{
+    return (sr <= 44100.0) ? "44K_16bit" : (sr <= 48000.0 ? "48K_24bit" : "96K_24bit");
+}
+
+juce::Vector3D<float> HRTFDatabase::toUnitVector (float azimuthDeg, float elevationDeg) noexcept
+{
+    const float a = juce::degreesToRadians (azimuthDeg);
+    const float e = juce::degreesToRadians (elevationDeg);
+    return { std::cos (e) * std::cos (a), std::cos (e) * std::sin (a), std::sin (e) };
+}
+
+void HRTFDatabase::allocate (int maxIRs, int length)
+{
+    constexpr int floatsPerLine = (int) (alignment / sizeof (float));
+
+    irLength = length;
+    irStride = (length + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+
+    arena = allocateAligned ((size_t) maxIRs * slotSize());
+
+    // keep each of the five direction arrays on its own cache line too
+    const size_t dirStride = (size_t) (maxIRs + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+    directions = allocateAligned (dirStride * 5);
+    azimuths   = directions;
+    elevations = directions + dirStride;
+    dirX       = directions + dirStride * 2;
+    dirY       = directions + dirStride * 3;
+    dirZ       = directions + dirStride * 4;
+}
+
+std::unique_ptr<HRTFDatabase> HRTFDatabase::loadFromFolder (const juce::File& subjectRoot, double sr,
+                                                           const Equalisation& equalisation)
+{
+    RealtimeSafetyChecker::assertNotAudioThread ("HRTFDatabase::loadFromFolder (file loading)");
+    const juce::SharedResourcePointer<LoadWorkers> workers;
+
+    if (!subjectRoot.isDirectory())
+        return nullptr;
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    juce::File targetDir = subjectRoot.getChildFile (getSubfolderNameForSampleRate (sr));
+
+    if (!targetDir.exists())
+    {
+        DBG("Target HRTF subdirectory not found: " + targetDir.getFullPathName());
+        return nullptr;
+    }
+
+    auto files = targetDir.findChildFiles (juce::File::findFiles, false, "*.wav");
+
+    if (files.isEmpty()) {
+        DBG("Error: No .wav files found in: " + targetDir.getFullPathName());
+        return nullptr;
+    }
+
+    // directory order isn't guaranteed, so sort to get the same slot layout every time
+    files.sort();
+    const int numFiles = files.size();
+
+    // SADIE IRs all have the same length within a folder, so the first readable one sizes the arena
+    auto db = std::make_unique<HRTFDatabase>();
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        for (auto& file : files)
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+            if (reader != nullptr && reader->lengthInSamples > 0)
+            {
+                db->sampleRate = reader->sampleRate;
+                db->allocate (numFiles, (int) reader->lengthInSamples);
+                break;
+            }
+        }
+    }
+
+    if (db->arena == nullptr)
+        return nullptr;
+
+    // names are cheap, parse them up front into the same slots the decode will fill
+    for (int i = 0; i < numFiles; ++i)
+    {
+        auto name = files.getReference (i).getFileNameWithoutExtension();
+        const float azi = wrap360 (parseAngle (name.fromFirstOccurrenceOf ("azi_", false, false).upToFirstOccurrenceOf ("_ele", false, false)));
+        const float ele = juce::jlimit (-90.0f, 90.0f, parseAngle (name.fromFirstOccurrenceOf ("ele_", false, false)));
+        const auto v = toUnitVector (azi, ele);
+
+        db->azimuths[i] = azi;
+        db->elevations[i] = ele;
+        db->dirX[i] = v.x;
+        db->dirY[i] = v.y;
+        db->dirZ[i] = v.z;
+    }
+
+    // decode straight into slot i on every core
+    std::vector<char> valid ((size_t) numFiles, 0);
+    std::vector<juce::uint64> slotHashes ((size_t) numFiles, 0);
+
+    parallelFor (numFiles, 64, [&] (int begin, int end)
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        juce::AudioBuffer<float> scratch (2, db->irLength);
+
+        for (int i = begin; i < end; ++i)
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (files.getReference (i)));
+
+            if (reader == nullptr || reader->lengthInSamples <= 0)
+                continue;
+
+            const int len = juce::jmin (db->irLength, (int) reader->lengthInSamples);
+            scratch.clear();
+            reader->read (&scratch, 0, len, 0, true, true);
+
+            auto* slot = db->arena + (size_t) i * db->slotSize();
+            const int srcR = reader->numChannels > 1 ? 1 : 0;
+            std::copy (scratch.getReadPointer (0), scratch.getReadPointer (0) + len, slot);
+            std::copy (scratch.getReadPointer (srcR), scratch.getReadPointer (srcR) + len, slot + db->irStride);
+
+            // the samples as decoded, before any EQ
+            slotHashes[(size_t) i] = hashBytes (slot + db->irStride, (size_t) len * sizeof (float),
+                                                hashBytes (slot, (size_t) len * sizeof (float)));
+            valid[(size_t) i] = 1;
+        }
+    });
+
+    // squeeze out files that failed to decode, keeping the sorted order
+    juce::uint64 hash = hashBytes (nullptr, 0);
+
+    for (int i = 0; i < numFiles; ++i)
+    {
+        if (!valid[(size_t) i])
+            continue;
+
+        hash = hashBytes (&slotHashes[(size_t) i], sizeof (juce::uint64), hash);
+        hash = hashBytes (&db->azimuths[i], sizeof (float), hash);
+        hash = hashBytes (&db->elevations[i], sizeof (float), hash);
+
+        const int dst = db->numIRs++;
+        if (dst == i)
+            continue;
+
+        auto* from = db->arena + (size_t) i * db->slotSize();
+        std::copy (from, from + db->slotSize(), db->arena + (size_t) dst * db->slotSize());
+
+        for (auto* array : { db->azimuths, db->elevations, db->dirX, db->dirY, db->dirZ })
+            array[dst] = array[i];
+    }
+
+    if (db->numIRs == 0)
+        return nullptr;
+
+    db->contentHash = hash;
+
+    if (equalisation.isActive())
+        db->applyEqualisation (equalisation);
+
+    DBG("Successfully cached " + juce::String (db->numIRs) + " HRTF files into RAM ("
+        + juce::String ((juce::int64) db->getArenaSizeInBytes()) + " bytes) in "
+        + juce::String (juce::Time::getMillisecondCounterHiRes() - startTime, 1) + " ms.");
+
+    return db;
+}
+
+int HRTFDatabase::findNearest (float azimuthDeg, float elevationDeg) const noexcept
+{
+    if (numIRs == 0) return -1;
+
+    if (!directionTable.empty())
+    {
+        const int a = juce::roundToInt (wrap360 (azimuthDeg)) % tableAzimuths;
+        const int e = juce::roundToInt (juce::jlimit (-90.0f, 90.0f, elevationDeg)) + 90;
+        return directionTable[(size_t) (e * tableAzimuths + a)];
+    }
+
+    return scanNearest (azimuthDeg, elevationDeg);
+}
+
+void HRTFDatabase::buildDirectionTable()
+{
+    // indices have to fit the 16 bit cells, bigger sets keep scanning
+    if (numIRs == 0 || numIRs > 65536)
+        return;
+
+    std::vector<uint16_t> table ((size_t) (tableAzimuths * tableElevations));
+
+    parallelFor (tableElevations, 8, [&] (int begin, int end)
+    {
+        for (int e = begin; e < end; ++e)
+            for (int a = 0; a < tableAzimuths; ++a)
+                table[(size_t) (e * tableAzimuths + a)] = (uint16_t) scanNearest ((float) a, (float) (e - 90));
+    });
+
+    directionTable = std::move (table);
+}
+
+int HRTFDatabase::scanNearest (float azimuthDeg, float elevationDeg) const noexcept
+{
+
+    const auto v = toUnitVector (azimuthDeg, elevationDeg);
+
+    int best = 0;
+    float bestDot = -2.0f;
+
+    for (int i = 0; i < numIRs; ++i)
+    {
+        const float d = dirX[i] * v.x + dirY[i] * v.y + dirZ[i] * v.z;
+        if (d > bestDot) { bestDot = d; best = i; }
+    }
+    return best;
+}
+
+void HRTFDatabase::prefetch (int index) const noexcept
+{
+   #if JUCE_GCC || JUCE_CLANG
+    // only the basis kept: a pair is its weights (the filters are shared and stay warm)
+    if (!hasIRs())
+    {
+        if (hasBasis())
+            __builtin_prefetch (getBasisWeights (index));
+        return;
+    }
+
+    const size_t sampleSize = compactArena != nullptr ? sizeof (int16_t) : sizeof (float);
+    const auto* p = static_cast<const char*> (getArenaData()) + (size_t) index * slotSize() * sampleSize;
+    for (size_t offset = 0; offset < slotSize() * sampleSize; offset += alignment)
+        __builtin_prefetch (p + offset);
+   #else
+    juce::ignoreUnused (index);
+   #endif
+}
+
+void HRTFDatabase::lockInMemory (MemoryLock::Set& set) const
+{
+    auto add = [&set] (const auto& v) { set.add (v.data(), v.size() * sizeof (v[0])); };
+
+    if (hasIRs())
+        set.add (getArenaData(), getArenaSizeInBytes());
+    if (basisSpectra != nullptr)
+        set.add (basisSpectra, (size_t) (numBasisComponents + 1) * 2 * (size_t) numBasisPartitions * 2 * basisBinStride * sizeof (float));
+    if (directions != nullptr)
+        set.add (directions, (size_t) (dirZ + numIRs - directions) * sizeof (float));
+
+    add (irScales);
+    add (directionTable);
+    add (basisFilters);
+    add (basisWeights);
+    add (basisDelays);
+    add (lodFilters);
+    add (lodDelays);
+    add (lodGains);
+}
+
+float HRTFDatabase::getKernelGain (const float* left, const float* right, int length) noexcept
+{
+    float energyL = 0.0f, energyR = 0.0f;
+    for (int i = 0; i < length; ++i)
+    {
+        energyL += left[i] * left[i];
+        energyR += right[i] * right[i];
+    }
+
+    const float maxEnergy = juce::jmax (energyL, energyR);
+    return maxEnergy > 0.0f ? 0.125f / std::sqrt (maxEnergy) : 0.0f;
+}
+
+HRTFDatabase::IRPair HRTFDatabase::fetchIR (int index, float* scratch) const noexcept
+{
+    if (arena != nullptr)
+        return { getLeftIR (index), getRightIR (index) };
+
+    if (compactArena == nullptr)
+    {
+        // mean + weighted components, each ear put back behind its onset (see buildBasis)
+        const int n = (irLength + 7) & ~7;
+        const float* weights = getBasisWeights (index);
+
+        for (int ear = 0; ear < 2; ++ear)
+        {
+            float* ir = scratch + ear * n;
+            const int delay = getBasisDelay (index, ear);
+            std::fill (ir, ir + n, 0.0f);
+
+            for (int c = 0; c <= numBasisComponents; ++c)
+                if (weights[c] != 0.0f)
+                    juce::FloatVectorOperations::addWithMultiply (ir + delay, getBasisFilter (c, ear), weights[c], irLength - delay);
+        }
+
+        return { scratch, scratch + n };
+    }
+
+    // whole vectors, block by block: n and the block length are multiples of 8 and the padding is zero
+    const int n = (irLength + 7) & ~7;
+    const auto* slot = compactArena + (size_t) index * slotSize();
+    const float* scales = irScales.data() + (size_t) index * 2 * (size_t) scalesPerEar;
+
+    for (int ear = 0; ear < 2; ++ear)
+    {
+        for (int b = 0; b < scalesPerEar; ++b)
+        {
+            const int start = b * compactBlockLength;
+            widen (slot + ear * irStride + start, scratch + ear * n + start, scales[ear * scalesPerEar + b],
+                   juce::jmin (compactBlockLength, n - start));
+        }
+    }
+
+    return { scratch, scratch + n };
+}
+
+void HRTFDatabase::keepOnlyBasis()
+{
+    if (!hasBasis() || arena == nullptr || irLength > maxCompactIRLength)
+        return;
+
+    const auto irBytes = getArenaSizeInBytes();
+    freeAligned (arena);
+    arena = nullptr;
+
+    DBG("HRTF IRs dropped for the basis, " + juce::String ((juce::int64) irBytes) + " bytes freed.");
+}
+
+void HRTFDatabase::convertTo16Bit()
+{
+    if (arena == nullptr || irLength > maxCompactIRLength)
+        return;
+
+    const size_t numSamples = (size_t) numIRs * slotSize();
+    auto* compact = static_cast<int16_t*> (::operator new (numSamples * sizeof (int16_t), std::align_val_t (alignment)));
+    std::fill (compact, compact + numSamples, (int16_t) 0);
+    scalesPerEar = (irLength + compactBlockLength - 1) / compactBlockLength;
+    irScales.assign ((size_t) numIRs * 2 * (size_t) scalesPerEar, 0.0f);
+
+    // worst error-to-signal ratio per chunk, so the report doesn't depend on the thread count
+    constexpr int chunkSize = 64;
+    std::vector<double> worstRatio ((size_t) ((numIRs + chunkSize - 1) / chunkSize), 0.0);
+
+    parallelFor (numIRs, chunkSize, [&] (int begin, int end)
+    {
+        auto& worst = worstRatio[(size_t) (begin / chunkSize)];
+
+        for (int i = begin; i < end; ++i)
+        {
+            for (int ear = 0; ear < 2; ++ear)
+            {
+                const float* src = arena + (size_t) i * slotSize() + (size_t) (ear * irStride);
+                int16_t* dst = compact + (size_t) i * slotSize() + (size_t) (ear * irStride);
+
+                float* scales = irScales.data() + ((size_t) i * 2 + (size_t) ear) * (size_t) scalesPerEar;
+                double signal = 0.0, error = 0.0;
+
+                // each block at its own full range, the quiet tail isn't rounded at the step of the peak
+                for (int b = 0; b < scalesPerEar; ++b)
+                {
+                    const int start = b * compactBlockLength, end = juce::jmin (irLength, start + compactBlockLength);
+
+                    float peak = 0.0f;
+                    for (int n = start; n < end; ++n)
+                        peak = juce::jmax (peak, std::abs (src[n]));
+
+                    const float scale = peak / 32767.0f;
+                    const float toInt = peak > 0.0f ? 32767.0f / peak : 0.0f;
+                    scales[b] = scale;
+
+                    for (int n = start; n < end; ++n)
+                    {
+                        dst[n] = (int16_t) juce::jlimit (-32767, 32767, juce::roundToInt (src[n] * toInt));
+
+                        const double e = (double) dst[n] * scale - src[n];
+                        signal += (double) src[n] * src[n];
+                        error += e * e;
+                    }
+                }
+
+                if (signal > 0.0)
+                    worst = juce::jmax (worst, error / signal);
+            }
+        }
+    });
+
+    double worst = 0.0;
+    for (auto w : worstRatio)
+        worst = juce::jmax (worst, w);
+
+    const auto floatBytes = getArenaSizeInBytes();
+
+    freeAligned (arena);
+    arena = nullptr;
+    compactArena = compact;
+    storageErrorDb = worst > 0.0 ? (float) (10.0 * std::log10 (worst)) : -200.0f;
+
+    DBG("HRTF arena stored as int16: " + juce::String ((juce::int64) floatBytes) + " -> "
+        + juce::String ((juce::int64) getArenaSizeInBytes()) + " bytes, worst IR error "
+        + juce::String (storageErrorDb, 1) + " dB.");
+}
+
+void HRTFDatabase::applyEqualisation (const Equalisation& equalisation)
+{
+    // 4x the IR length gives enough frequency resolution and room for the EQ's own response
+    const int order = juce::jlimit (8, 15, (int) std::ceil (std::log2 ((double) irLength)) + 2);
+    const int n = 1 << order;
+    constexpr int chunkSize = 64;
+
+    SpectrumScratch scratch (order);
+    std::vector<Complex> eq ((size_t) n, Complex (1.0f));
+
+    if (equalisation.diffuseField)
+    {
+        // SADIE grids are denser towards the poles, so weight every IR by the area its
+        // elevation ring covers (cos(ele)) shared between the points on that ring
+        std::map<int, int> ringCounts;
+        for (int i = 0; i < numIRs; ++i)
+            ++ringCounts[juce::roundToInt (elevations[i] * 10.0f)];
+
+        std::vector<double> weights ((size_t) numIRs);
+        for (int i = 0; i < numIRs; ++i)
+            weights[(size_t) i] = std::cos (juce::degreesToRadians ((double) elevations[i]))
+                                   / (double) ringCounts[juce::roundToInt (elevations[i] * 10.0f)];
+
+        // per-chunk partial sums, added up in chunk order so the result doesn't depend on the thread count
+        const int numChunks = (numIRs + chunkSize - 1) / chunkSize;
+        std::vector<std::vector<double>> partialPower ((size_t) numChunks);
+
+        parallelFor (numIRs, chunkSize, [&] (int begin, int end)
+        {
+            SpectrumScratch local (order);
+            auto& power = partialPower[(size_t) (begin / chunkSize)];
+            power.assign ((size_t) (n / 2 + 1), 0.0);
+
+            for (int i = begin; i < end; ++i)
+            {
+                for (auto* ir : { getLeftIR (i), getRightIR (i) })
+                {
+                    local.forward (ir, irLength);
+                    for (int k = 0; k <= n / 2; ++k)
+                        power[(size_t) k] += weights[(size_t) i] * (double) std::norm (local.spectrum[(size_t) k]);
+                }
+            }
+        });
+
+        std::vector<double> power ((size_t) (n / 2 + 1), 0.0);
+        for (auto& partial : partialPower)
+            for (int k = 0; k <= n / 2; ++k)
+                power[(size_t) k] += partial[(size_t) k];
+
+        double totalWeight = 0.0;
+        for (auto w : weights)
+            totalWeight += 2.0 * w;
+
+        // third-octave smoothing, so we correct the broad colouration and not every notch
+        std::vector<double> prefix ((size_t) (n / 2 + 2), 0.0);
+        for (int k = 0; k <= n / 2; ++k)
+            prefix[(size_t) k + 1] = prefix[(size_t) k] + power[(size_t) k] / juce::jmax (1.0e-12, totalWeight);
+
+        const double halfBand = std::pow (2.0, 1.0 / 6.0);
+        std::vector<float> inverse ((size_t) (n / 2 + 1));
+
+        for (int k = 0; k <= n / 2; ++k)
+        {
+            const int lo = juce::jmax (0, (int) std::floor (k / halfBand));
+            const int hi = juce::jmin (n / 2, juce::jmax (lo + 1, (int) std::ceil (k * halfBand)));
+            const double avg = (prefix[(size_t) hi + 1] - prefix[(size_t) lo]) / (double) (hi - lo + 1);
+            inverse[(size_t) k] = (float) (1.0 / std::sqrt (juce::jmax (1.0e-12, avg)));
+        }
+
+        // keep the overall level where it was (mean over 200 Hz - 8 kHz) and limit to +-18 dB
+        const int k200 = juce::jmax (1, (int) (200.0 * n / sampleRate));
+        const int k8k  = juce::jlimit (k200 + 1, n / 2, (int) (8000.0 * n / sampleRate));
+        double sum = 0.0;
+        for (int k = k200; k < k8k; ++k)
+            sum += inverse[(size_t) k];
+        const float reference = (float) (sum / (k8k - k200));
+        const float limit = juce::Decibels::decibelsToGain (18.0f);
+
+        for (auto& g : inverse)
+            g = juce::jlimit (1.0f / limit, limit, g / reference);
+
+        makeMinimumPhase (scratch.fft, inverse, eq);
+    }
+
+    if (equalisation.headphoneFilter.existsAsFile())
+    {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        if (std::unique_ptr<juce::AudioFormatReader> reader { formatManager.createReaderFor (equalisation.headphoneFilter) })
+        {
+            if (std::abs (reader->sampleRate - sampleRate) > 1.0)
+                DBG("Headphone EQ sample rate (" << reader->sampleRate << ") doesn't match the HRIRs (" << sampleRate << ")");
+
+            const int len = (int) juce::jmin ((juce::int64) (n - irLength), reader->lengthInSamples);
+            juce::AudioBuffer<float> filter (1, len);
+            reader->read (&filter, 0, len, 0, true, false);
+
+            scratch.forward (filter.getReadPointer (0), len);
+            for (int k = 0; k < n; ++k)
+                eq[(size_t) k] *= scratch.spectrum[(size_t) k];
+        }
+    }
+
+    // bake it in, keeping the original length (and so the runtime cost); every IR is independent
+    const int fadeLen = juce::jmin (16, irLength);
+
+    parallelFor (numIRs, chunkSize, [&] (int begin, int end)
+    {
+        SpectrumScratch local (order);
+
+        for (int i = begin; i < end; ++i)
+        {
+            for (auto* ir : { arena + (size_t) i * slotSize(), arena + (size_t) i * slotSize() + (size_t) irStride })
+            {
+                local.forward (ir, irLength);
+                for (int k = 0; k < n; ++k)
+                    local.spectrum[(size_t) k] *= eq[(size_t) k];
+                local.fft.perform (local.spectrum.data(), local.timeDomain.data(), true);
+
+                for (int s = 0; s < irLength; ++s)
+                {
+                    const int fromEnd = irLength - 1 - s;
+                    const float fade = fromEnd < fadeLen ? (float) fromEnd / (float) fadeLen : 1.0f;
+                    ir[s] = local.timeDomain[(size_t) s].real() * fade;
+                }
+            }
+        }
+    });
+
+    DBG("HRTF equalisation baked in (diffuse-field: " << (equalisation.diffuseField ? "on" : "off")
+        << ", headphone: " << equalisation.headphoneFilter.getFileName() << ")");
+}
+
+void HRTFDatabase::buildBasis (int numComponents)
+{
+    const int len = irLength;
+    const int dims = 2 * len;
+    const int numK = juce::jlimit (1, juce::jmin (maxBasisComponents, dims, numIRs), numComponents);
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    // 1. onsets out: the interaural delay would otherwise need dozens of components on its own
+    constexpr int onsetMargin = 4;
+    std::vector<float> aligned ((size_t) numIRs * (size_t) dims, 0.0f);
+    std::vector<float> gains ((size_t) numIRs);
+    basisDelays.assign ((size_t) numIRs * 2, 0);
+
+    parallelFor (numIRs, 64, [&] (int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            for (int ear = 0; ear < 2; ++ear)
+            {
+                const float* ir = ear == 0 ? getLeftIR (i) : getRightIR (i);
+
+                const int onset = juce::jmax (0, findOnset (ir, len) - onsetMargin);
+
+                basisDelays[(size_t) i * 2 + (size_t) ear] = (uint16_t) onset;
+                std::copy (ir + onset, ir + len, aligned.data() + (size_t) i * (size_t) dims + (size_t) (ear * len));
+            }
+
+            // same as PartitionedConvolver::transformKernel, so both paths play at one level
+            gains[(size_t) i] = getKernelGain (getLeftIR (i), getRightIR (i), len);
+        }
+    });
+
+    // 2. mean out
+    std::vector<double> mean ((size_t) dims, 0.0);
+    for (int i = 0; i < numIRs; ++i)
+        for (int d = 0; d < dims; ++d)
+            mean[(size_t) d] += aligned[(size_t) i * (size_t) dims + (size_t) d];
+    for (auto& m : mean)
+        m /= (double) numIRs;
+
+    parallelFor (numIRs, 64, [&] (int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            for (int d = 0; d < dims; ++d)
+                aligned[(size_t) i * (size_t) dims + (size_t) d] -= (float) mean[(size_t) d];
+    });
+
+    // 3. covariance (upper triangle, rows in parallel, then mirrored)
+    std::vector<float> cov ((size_t) dims * (size_t) dims, 0.0f);
+
+    parallelFor (dims, 32, [&] (int begin, int end)
+    {
+        for (int i = 0; i < numIRs; ++i)
+        {
+            const float* a = aligned.data() + (size_t) i * (size_t) dims;
+            for (int r = begin; r < end; ++r)
+            {
+                const float ar = a[r];
+                if (ar == 0.0f)
+                    continue;
+
+                float* row = cov.data() + (size_t) r * (size_t) dims;
+                for (int c = r; c < dims; ++c)
+                    row[c] += ar * a[c];
+            }
+        }
+    });
+
+    double totalVariance = 0.0;
+    for (int r = 0; r < dims; ++r)
+    {
+        totalVariance += cov[(size_t) r * (size_t) dims + (size_t) r];
+        for (int c = 0; c < r; ++c)
+            cov[(size_t) r * (size_t) dims + (size_t) c] = cov[(size_t) c * (size_t) dims + (size_t) r];
+    }
+
+    // 4. top-K subspace by orthogonal iteration, fixed seed so every load gives the same basis
+    std::vector<float> q ((size_t) numK * (size_t) dims), z ((size_t) numK * (size_t) dims);
+    juce::Random random (0x5AD1E);
+    for (auto& x : q)
+        x = random.nextFloat() - 0.5f;
+
+    auto multiplyCovariance = [&]
+    {
+        parallelFor (numK, 1, [&] (int begin, int end)
+        {
+            for (int k = begin; k < end; ++k)
+            {
+                const float* in = q.data() + (size_t) k * (size_t) dims;
+                float* out = z.data() + (size_t) k * (size_t) dims;
+                for (int r = 0; r < dims; ++r)
+                {
+                    const float* row = cov.data() + (size_t) r * (size_t) dims;
+                    float sum = 0.0f;
+                    for (int c = 0; c < dims; ++c)
+                        sum += row[c] * in[c];
+                    out[r] = sum;
+                }
+            }
+        });
+    };
+
+    // Gram-Schmidt, twice per vector so float round-off doesn't leave the basis skewed. A vector with
+    // next to nothing left (the set has fewer dimensions than asked for) starts again from noise
+    auto orthonormalise = [&] (std::vector<float>& vectors)
+    {
+        for (int k = 0; k < numK; ++k)
+        {
+            float* v = vectors.data() + (size_t) k * (size_t) dims;
+
+            for (int attempt = 0; attempt < 3; ++attempt)
+            {
+                double before = 0.0;
+                for (int n = 0; n < dims; ++n)
+                    before += (double) v[n] * v[n];
+
+                for (int pass = 0; pass < 2; ++pass)
+                {
+                    for (int j = 0; j < k; ++j)
+                    {
+                        const float* u = vectors.data() + (size_t) j * (size_t) dims;
+                        double d = 0.0;
+                        for (int n = 0; n < dims; ++n)
+                            d += (double) v[n] * u[n];
+                        for (int n = 0; n < dims; ++n)
+                            v[n] -= (float) d * u[n];
+                    }
+                }
+
+                double norm = 0.0;
+                for (int n = 0; n < dims; ++n)
+                    norm += (double) v[n] * v[n];
+
+                if (norm > 1.0e-8 * before && norm > 0.0)
+                {
+                    const float scale = (float) (1.0 / std::sqrt (norm));
+                    for (int n = 0; n < dims; ++n)
+                        v[n] *= scale;
+                    break;
+                }
+
+                for (int n = 0; n < dims; ++n)
+                    v[n] = random.nextFloat() - 0.5f;
+            }
+        }
+    };
+
+    orthonormalise (q);
+    for (int iteration = 0; iteration < 50; ++iteration)
+    {
+        multiplyCovariance();
+        std::swap (q, z);
+        orthonormalise (q);
+    }
+
+    // 5. order the components by the energy they carry (Rayleigh-Ritz on the subspace)
+    multiplyCovariance();
+    std::vector<double> projected ((size_t) (numK * numK)), eigenvectors;
+    for (int a = 0; a < numK; ++a)
+        for (int b = 0; b < numK; ++b)
+        {
+            double d = 0.0;
+            for (int n = 0; n < dims; ++n)
+                d += (double) q[(size_t) a * (size_t) dims + (size_t) n] * z[(size_t) b * (size_t) dims + (size_t) n];
+            projected[(size_t) (a * numK + b)] = d;
+        }
+
+    jacobiEigen (projected, eigenvectors, numK);
+
+    std::vector<int> order ((size_t) numK);
+    std::iota (order.begin(), order.end(), 0);
+    std::sort (order.begin(), order.end(), [&] (int a, int b) { return projected[(size_t) (a * numK + a)] > projected[(size_t) (b * numK + b)]; });
+
+    double keptVariance = 0.0;
+    std::fill (z.begin(), z.end(), 0.0f);
+    for (int k = 0; k < numK; ++k)
+    {
+        const int m = order[(size_t) k];
+        keptVariance += projected[(size_t) (m * numK + m)];
+
+        float* out = z.data() + (size_t) k * (size_t) dims;
+        for (int a = 0; a < numK; ++a)
+        {
+            const float w = (float) eigenvectors[(size_t) (a * numK + m)];
+            const float* in = q.data() + (size_t) a * (size_t) dims;
+            for (int n = 0; n < dims; ++n)
+                out[n] += w * in[n];
+        }
+    }
+    std::swap (q, z);
+
+    // 6. filters: mean, then the components, each split into its two ears
+    basisFilters.assign ((size_t) (numK + 1) * (size_t) dims, 0.0f);
+    for (int d = 0; d < dims; ++d)
+        basisFilters[(size_t) d] = (float) mean[(size_t) d];
+    std::copy (q.begin(), q.end(), basisFilters.begin() + dims);
+
+    // 7. per direction: projections onto the components, all scaled by the kernel normalisation
+    basisWeights.assign ((size_t) numIRs * (size_t) (numK + 1), 0.0f);
+
+    parallelFor (numIRs, 64, [&] (int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            const float* a = aligned.data() + (size_t) i * (size_t) dims;
+            float* w = basisWeights.data() + (size_t) i * (size_t) (numK + 1);
+            w[0] = gains[(size_t) i];
+
+            for (int k = 0; k < numK; ++k)
+            {
+                const float* component = q.data() + (size_t) k * (size_t) dims;
+                float d = 0.0f;
+                for (int n = 0; n < dims; ++n)
+                    d += a[n] * component[n];
+                w[k + 1] = gains[(size_t) i] * d;
+            }
+        }
+    });
+
+    numBasisComponents = numK;
+    basisAccuracy = totalVariance > 0.0 ? (float) juce::jlimit (0.0, 1.0, keptVariance / totalVariance) : 1.0f;
+
+    // 8. the filters' spectra, partitioned the way BasisRenderer runs them; the kernel normalisation is in the weights
+    const int spectraLength = juce::jmin (len, maxBasisKernelLength);
+    numBasisPartitions = (spectraLength + basisPartitionSize - 1) / basisPartitionSize;
+    freeAligned (basisSpectra);
+    basisSpectra = allocateAligned ((size_t) (numK + 1) * 2 * (size_t) numBasisPartitions * 2 * basisBinStride);
+
+    parallelFor ((numK + 1) * 2, 8, [&] (int begin, int end)
+    {
+        juce::dsp::FFT fft (juce::roundToInt (std::log2 (2 * basisPartitionSize)));
+        std::vector<float> buffer ((size_t) (4 * basisPartitionSize));
+
+        for (int channel = begin; channel < end; ++channel)
+        {
+            const float* filter = basisFilters.data() + (size_t) channel * (size_t) len;
+
+            for (int p = 0; p < numBasisPartitions; ++p)
+            {
+                const int offset = p * basisPartitionSize;
+                std::fill (buffer.begin(), buffer.end(), 0.0f);
+                std::copy (filter + offset, filter + offset + juce::jmin (basisPartitionSize, spectraLength - offset), buffer.begin());
+                fft.performRealOnlyForwardTransform (buffer.data(), true);
+
+                float* re = basisSpectra + ((size_t) channel * (size_t) numBasisPartitions + (size_t) p) * 2 * basisBinStride;
+                float* im = re + basisBinStride;
+                for (int k = 0; k <= basisPartitionSize; ++k)
+                {
+                    re[k] = buffer[(size_t) (2 * k)];
+                    im[k] = buffer[(size_t) (2 * k + 1)];
+                }
+            }
+        }
+    });
+
+    DBG("HRTF basis: " + juce::String (numK) + " components keep " + juce::String (basisAccuracy * 100.0f, 2) + "% of the energy, "
+        + juce::String ((juce::int64) ((basisFilters.size() + basisWeights.size()) * sizeof (float) + basisDelays.size() * sizeof (uint16_t)))
+        + " bytes, built in " + juce::String (juce::Time::getMillisecondCounterHiRes() - startTime, 1) + " ms.");
+}
+
+void HRTFDatabase::buildLevelsOfDetail()
+{
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    // ~1.3 ms of minimum phase filter keeps the pinna cues, the rest is room for the onset delay
+    lodLength = juce::jmin (irLength, 64 * juce::jmax (1, juce::roundToInt (sampleRate / 48000.0)));
+
+    const int order = juce::jlimit (8, 15, (int) std::ceil (std::log2 ((double) irLength)) + 2);
+    const int n = 1 << order;
+    const int fadeLen = juce::jmin (16, lodLength);
+
+    // the shelving tier's one-pole split (see LODVoice), as power responses per bin
+    const double a = std::exp (-juce::MathConstants<double>::twoPi * shelfFrequency / sampleRate);
+    std::vector<double> lowResponse ((size_t) (n / 2 + 1)), highResponse ((size_t) (n / 2 + 1));
+    double lowReference = 0.0, highReference = 0.0;
+
+    for (int k = 0; k <= n / 2; ++k)
+    {
+        const std::complex<double> z = std::polar (1.0, -juce::MathConstants<double>::twoPi * k / n);
+        const auto low = (1.0 - a) / (1.0 - a * z);
+        lowResponse[(size_t) k] = std::norm (low);
+        highResponse[(size_t) k] = std::norm (1.0 - low);
+        lowReference += lowResponse[(size_t) k];
+        highReference += highResponse[(size_t) k];
+    }
+
+    lodFilters.assign ((size_t) numIRs * 2 * (size_t) lodLength, 0.0f);
+    lodDelays.assign ((size_t) numIRs * 2, 0);
+    lodGains.assign ((size_t) numIRs * 2 * 3, 0.0f);
+
+    parallelFor (numIRs, 64, [&] (int begin, int end)
+    {
+        SpectrumScratch local (order);
+        std::vector<float> magnitude ((size_t) (n / 2 + 1));
+        std::vector<Complex> minimumPhase;
+
+        for (int i = begin; i < end; ++i)
+        {
+            const float* irs[2] = { getLeftIR (i), getRightIR (i) };
+
+            // same normalisation as the convolvers, so every tier plays at the level of the full one
+            const float gain = getKernelGain (irs[0], irs[1], irLength);
+
+            for (int ear = 0; ear < 2; ++ear)
+            {
+                lodDelays[(size_t) i * 2 + (size_t) ear] = (uint16_t) findOnset (irs[ear], irLength);
+
+                local.forward (irs[ear], irLength);
+
+                double lowEnergy = 0.0, highEnergy = 0.0;
+                for (int k = 0; k <= n / 2; ++k)
+                {
+                    const double power = std::norm (local.spectrum[(size_t) k]);
+                    magnitude[(size_t) k] = (float) std::sqrt (power);
+                    lowEnergy += power * lowResponse[(size_t) k];
+                    highEnergy += power * highResponse[(size_t) k];
+                }
+
+                auto* gains = lodGains.data() + ((size_t) i * 2 + (size_t) ear) * 3;
+                gains[0] = gain * (float) std::sqrt (lowEnergy / lowReference);
+                gains[1] = gain * (float) std::sqrt (highEnergy / highReference);
+                gains[2] = gain * std::sqrt (energy[ear]);
+
+                // the magnitude as a minimum phase filter: no delay of its own, the onset is added back separately
+                makeMinimumPhase (local.fft, magnitude, minimumPhase);
+                local.fft.perform (minimumPhase.data(), local.timeDomain.data(), true);
+
+                auto* filter = lodFilters.data() + ((size_t) i * 2 + (size_t) ear) * (size_t) lodLength;
+                for (int s = 0; s < lodLength; ++s)
+                {
+                    const int fromEnd = lodLength - 1 - s;
+                    const float fade = fromEnd < fadeLen ? (float) fromEnd / (float) fadeLen : 1.0f;
+                    filter[s] = local.timeDomain[(size_t) s].real() * fade * gain;
+                }
+            }
+        }
+    });
+
+    DBG("HRTF levels of detail: " + juce::String (lodLength) + "-tap minimum phase filters, built in "
+        + juce::String (juce::Time::getMillisecondCounterHiRes() - startTime, 1) + " ms.");
+}
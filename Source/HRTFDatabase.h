@@ -0,0 +1,209 @@
+#pragma once
+#include <JuceHeader.h>
+#include "MemoryLock.h"
+
+// One SADIE subject at one sample rate, packed into a single 64-byte aligned arena.
+// IR i lives at slot i: left ear first, right ear straight after, each padded to a whole
+// number of cache lines. Directions are kept in separate arrays (structure-of-arrays),
+// so the nearest-direction scan only walks the unit vectors and never touches the IRs.
+// Optionally the arena is stored as 16-bit (see SampleFormat), then IRs are read through fetchIR().
+class HRTFDatabase
+{
+public:
+    HRTFDatabase() = default;
+    ~HRTFDatabase();
+
+    // How the IR samples are kept in RAM. float32 is read in place; int16 halves the arena (and what a
+    // kernel swap pulls through the cache), one scale per compactBlockLength samples of each ear so the
+    // quiet tail keeps the whole 16-bit range as well as the peak (worst IR error under -80 dB on SADIE).
+    enum class SampleFormat { float32, int16 };
+    static constexpr int maxCompactIRLength = 1024; // longer sets stay float32
+    static constexpr int compactBlockLength = 32;
+
+    // Colouration correction, baked straight into the stored IRs at load time so the
+    // audio thread never runs an extra filter for it.
+    struct Equalisation
+    {
+        // a constructor rather than member initialisers, so "= {}" below compiles on GCC too
+        Equalisation() : diffuseField (false) {}
+
+        // Inverse of the (solid-angle weighted) average spectrum of the whole set, minimum phase.
+        // Removes the measurement chain / common ear-canal colouration.
+        bool diffuseField;
+
+        // Optional headphone correction FIR (.wav, first channel, used as-is).
+        // Truncated to the HRIR length, so keep it short / minimum phase.
+        juce::File headphoneFilter;
+
+        bool isActive() const { return diffuseField || headphoneFilter.existsAsFile(); }
+    };
+
+    // Loads <subjectRoot>/<44K_16bit|48K_24bit|96K_24bit>/*.wav, picked by sample rate.
+    // Returns nullptr if the folder doesn't exist or holds no readable IRs.
+    static std::unique_ptr<HRTFDatabase> loadFromFolder (const juce::File& subjectRoot, double sampleRate,
+                                                         const Equalisation& equalisation = {});
+
+    // Same, through a process-wide cache: instances asking for the same folder, rate and EQ share
+    // one database (and its direction table) for as long as any of them holds it.
+    // basisComponents > 0 also builds the principal-component model (buildBasis) and then keeps only that
+    // (keepOnlyBasis), levelsOfDetail the reduced IRs (buildLevelsOfDetail), and the samples are converted
+    // to `format` last, once everything that needs the full-precision IRs has run.
+    static std::shared_ptr<const HRTFDatabase> loadShared (const juce::File& subjectRoot, double sampleRate,
+                                                           const Equalisation& equalisation = {}, int basisComponents = 0,
+                                                           SampleFormat format = SampleFormat::float32, bool levelsOfDetail = false);
+
+    static juce::String getSubfolderNameForSampleRate (double sampleRate);
+
+    int getNumIRs() const noexcept          { return numIRs; }
+    int getIRLength() const noexcept        { return irLength; }
+    double getSampleRate() const noexcept   { return sampleRate; }
+
+    // Fingerprint of the set as decoded (samples and directions, before any EQ), so a saved
+    // session can tell whether the folder it points at still holds the same measurements.
+    juce::uint64 getContentHash() const noexcept { return contentHash; }
+
+    SampleFormat getSampleFormat() const noexcept { return compactArena != nullptr ? SampleFormat::int16 : SampleFormat::float32; }
+
+    // float32 sets only, straight into the arena
+    const float* getLeftIR (int index) const noexcept   { jassert (arena != nullptr); return arena + (size_t) index * slotSize(); }
+    const float* getRightIR (int index) const noexcept  { jassert (arena != nullptr); return arena + (size_t) index * slotSize() + (size_t) irStride; }
+
+    // IR pair `index` as floats, whatever the storage: in place for float32, widened into `scratch`
+    // (at least fetchScratchSize floats) for int16, rebuilt from the basis into `scratch` if only that is kept
+    // (at the convolvers' kernel level then, which every user normalises to anyway).
+    static constexpr int fetchScratchSize = 2 * maxCompactIRLength;
+    struct IRPair { const float* left; const float* right; };
+    IRPair fetchIR (int index, float* scratch) const noexcept;
+
+    // The level the convolvers play a pair at: 0.125 / sqrt (energy of the louder ear), as juce::dsp::Convolution
+    // with Normalise::yes did. Anything else rendering the IRs uses it too, so it sits at the same level.
+    static float getKernelGain (const float* left, const float* right, int length) noexcept;
+
+    // Converts the arena to int16 (no-op for long IRs). Call before sharing, after anything that
+    // reads the IRs through getLeftIR / getRightIR.
+    void convertTo16Bit();
+
+    // worst IR's quantisation error relative to its own level, dB (0 for float32)
+    float getStorageErrorDb() const noexcept { return storageErrorDb; }
+
+    float getAzimuth (int index) const noexcept     { return azimuths[index]; }
+    float getElevation (int index) const noexcept   { return elevations[index]; }
+
+    // Index of the measurement closest (largest dot product) to the given direction, or -1 if empty.
+    // A single table load once buildDirectionTable() has run, a scan over all directions otherwise.
+    int findNearest (float azimuthDeg, float elevationDeg) const noexcept;
+
+    // Precomputes the nearest measurement for every cell of a 1 deg x 1 deg azimuth / elevation grid
+    // (360 x 181 cells, 2 bytes each). Call before the database is shared; loadShared always does, the
+    // ~130 KB is paid once per shared set. Cells hold one index and no weights: every renderer plays a
+    // single measured pair and crossfades to the next, so there's nothing to interpolate between.
+    void buildDirectionTable();
+    bool hasDirectionTable() const noexcept { return !directionTable.empty(); }
+
+    // Principal-component model of the set, for rendering in the basis domain (see BasisRenderer).
+    // Each ear is shifted to start just before its direct sound (the shift is given back as a delay),
+    // then every aligned L+R pair is approximated as mean + sum of w_k * component_k. Call before sharing.
+    static constexpr int maxBasisComponents = 64;
+    void buildBasis (int numComponents);
+
+    bool hasBasis() const noexcept              { return numBasisComponents > 0; }
+    int getNumBasisComponents() const noexcept  { return numBasisComponents; }
+
+    // filter 0 is the mean, 1..K the components; irLength samples each, onset-aligned
+    const float* getBasisFilter (int filter, int ear) const noexcept { return basisFilters.data() + ((size_t) filter * 2 + (size_t) ear) * (size_t) irLength; }
+
+    // K + 1 weights of IR `index` (the mean's first), with the same kernel normalisation as the convolvers
+    const float* getBasisWeights (int index) const noexcept { return basisWeights.data() + (size_t) index * (size_t) (numBasisComponents + 1); }
+    int getBasisDelay (int index, int ear) const noexcept   { return basisDelays[(size_t) index * 2 + (size_t) ear]; }
+
+    // The filters' spectra as BasisRenderer convolves them, made by buildBasis so a new set never costs the
+    // audio thread an FFT: partitions of basisPartitionSize samples (up to maxBasisKernelLength), zero-padded
+    // to twice that, bins 0..basisPartitionSize split into re then im, basisBinStride floats each, cache-line aligned.
+    static constexpr int basisPartitionSize = 128, basisBinStride = 144, maxBasisKernelLength = 1024;
+    int getNumBasisPartitions() const noexcept { return numBasisPartitions; }
+    const float* getBasisSpectrum (int filter, int ear, int partition) const noexcept
+    {
+        return basisSpectra + (((size_t) filter * 2 + (size_t) ear) * (size_t) numBasisPartitions + (size_t) partition) * 2 * basisBinStride;
+    }
+
+    // Frees the IRs, leaving the basis (filters, weights, onsets) to stand for them: fetchIR() rebuilds a pair
+    // when it's asked for. Does nothing without a basis, or for IRs too long for fetchIR's scratch. Call before sharing.
+    void keepOnlyBasis();
+    bool hasIRs() const noexcept { return arena != nullptr || compactArena != nullptr; }
+
+    // share of the set's (aligned, mean-removed) energy the components keep, 0..1
+    float getBasisAccuracy() const noexcept { return basisAccuracy; }
+
+    // Cheaper stand-ins for every IR, for the level-of-detail tiers (see LODVoice): a short minimum
+    // phase version plus the onset delay it lost, and the ear's level below / above shelfFrequency
+    // and overall. All with the convolvers' kernel normalisation folded in. Call before sharing.
+    static constexpr double shelfFrequency = 2000.0;
+    void buildLevelsOfDetail();
+
+    bool hasLevelsOfDetail() const noexcept { return lodLength > 0; }
+    int getMinimumPhaseLength() const noexcept { return lodLength; }
+    const float* getMinimumPhaseIR (int index, int ear) const noexcept { return lodFilters.data() + ((size_t) index * 2 + (size_t) ear) * (size_t) lodLength; }
+    int getOnsetDelay (int index, int ear) const noexcept { return lodDelays[(size_t) index * 2 + (size_t) ear]; }
+
+    // low band, high band, broadband
+    const float* getBandGains (int index, int ear) const noexcept { return lodGains.data() + ((size_t) index * 2 + (size_t) ear) * 3; }
+
+    // Hint the cache that IR `index` is about to be read.
+    void prefetch (int index) const noexcept;
+
+    // Adds every block the audio thread may read (IRs, directions and table, basis / level-of-detail
+    // data) to `set`, which prefaults and locks them. Undone when the set is cleared.
+    void lockInMemory (MemoryLock::Set& set) const;
+
+    const void* getArenaData() const noexcept  { return compactArena != nullptr ? (const void*) compactArena : (const void*) arena; }
+    size_t getArenaSizeInBytes() const noexcept { return hasIRs() ? (size_t) numIRs * slotSize() * (compactArena != nullptr ? sizeof (int16_t) : sizeof (float)) : 0; }
+
+    static constexpr size_t alignment = 64;
+
+    // azimuth 0 = front, 90 = left; elevation +90 = up
+    static juce::Vector3D<float> toUnitVector (float azimuthDeg, float elevationDeg) noexcept;
+
+private:
+    size_t slotSize() const noexcept { return (size_t) irStride * 2; }
+
+    void allocate (int maxIRs, int length);
+    void applyEqualisation (const Equalisation& equalisation);
+    int scanNearest (float azimuthDeg, float elevationDeg) const noexcept;
+
+    int numIRs = 0;
+    int irLength = 0;
+    int irStride = 0;  // irLength rounded up to a whole cache line
+    double sampleRate = 0.0;
+    juce::uint64 contentHash = 0;
+
+    float* arena = nullptr;      // [numIRs][2][irStride], null once converted
+    int16_t* compactArena = nullptr; // same layout, int16
+    std::vector<float> irScales;     // [numIRs][ear][block], int16 -> float
+    int scalesPerEar = 0;
+    float storageErrorDb = 0.0f;
+    float* directions = nullptr; // one block holding the five arrays below
+
+    float* azimuths = nullptr;
+    float* elevations = nullptr;
+    float* dirX = nullptr;
+    float* dirY = nullptr;
+    float* dirZ = nullptr;
+
+    static constexpr int tableAzimuths = 360, tableElevations = 181;
+    std::vector<uint16_t> directionTable; // [elevation + 90][azimuth], empty until built
+
+    int numBasisComponents = 0;
+    float basisAccuracy = 0.0f;
+    std::vector<float> basisFilters;  // [K + 1][ear][irLength]
+    std::vector<float> basisWeights;  // [numIRs][K + 1]
+    std::vector<uint16_t> basisDelays; // [numIRs][ear]
+    float* basisSpectra = nullptr;     // [K + 1][ear][partition][re, im], see getBasisSpectrum
+    int numBasisPartitions = 0;
+
+    int lodLength = 0;
+    std::vector<float> lodFilters;    // [numIRs][ear][lodLength]
+    std::vector<uint16_t> lodDelays;  // [numIRs][ear]
+    std::vector<float> lodGains;      // [numIRs][ear][low, high, broadband]
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HRTFDatabase)
+};
@@ -0,0 +1,106 @@
+#include "HRTFDatabasePublisher.h"
+#include "RealtimeSafety.h"
+
+HRTFDatabasePublisher::HRTFDatabasePublisher()
+{
+    // start with an empty snapshot so the reader never sees nullptr
+    currentOwner = std::make_unique<Snapshot>();
+    current.store (currentOwner.get());
+}
+
+HRTFDatabasePublisher::~HRTFDatabasePublisher()
+{
+    stopTimer();
+}
+
+void HRTFDatabasePublisher::publish (std::shared_ptr<const HRTFDatabase> newDatabase)
+{
+    RealtimeSafetyChecker::assertNotAudioThread ("HRTFDatabasePublisher::publish (writeLock)");
+
+    auto next = std::make_unique<Snapshot>();
+    next->database = std::move (newDatabase);
+
+    {
+        const juce::ScopedLock sl (writeLock);
+
+        next->version = nextVersion++;
+        current.store (next.get(), std::memory_order_seq_cst);
+
+        retired.push_back (std::move (currentOwner));
+        currentOwner = std::move (next);
+    }
+
+    collectRetired();
+}
+
+std::shared_ptr<const HRTFDatabase> HRTFDatabasePublisher::getLatest() const
+{
+    RealtimeSafetyChecker::assertNotAudioThread ("HRTFDatabasePublisher::getLatest (writeLock)");
+
+    const juce::ScopedLock sl (writeLock);
+    return currentOwner->database;
+}
+
+void HRTFDatabasePublisher::collectRetired()
+{
+    std::vector<std::unique_ptr<Snapshot>> toFree;
+
+    {
+        const juce::ScopedLock sl (writeLock);
+
+        // anything the audio thread isn't pinning right now can go; it can't pick up a retired
+        // snapshot again because current no longer points at it
+        const auto* pinned = hazard.load (std::memory_order_seq_cst);
+
+        for (auto it = retired.begin(); it != retired.end();)
+        {
+            if (it->get() != pinned)
+            {
+                toFree.push_back (std::move (*it));
+                it = retired.erase (it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        if (retired.empty())
+            stopTimer();
+        else if (!isTimerRunning())
+            startTimer (50);
+    }
+
+    // the (possibly large) databases are released here, outside the lock
+}
+
+void HRTFDatabasePublisher::timerCallback()
+{
+    collectRetired();
+}
+
+//==============================================================================
+HRTFDatabasePublisher::ReadScope::ReadScope (HRTFDatabasePublisher& p) noexcept
+    : publisher (p)
+{
+    // classic hazard pointer acquire: publish what we're about to use, then make sure it's still current
+    const Snapshot* s = publisher.current.load (std::memory_order_acquire);
+
+    for (;;)
+    {
+        publisher.hazard.store (s, std::memory_order_seq_cst);
+        const Snapshot* check = publisher.current.load (std::memory_order_seq_cst);
+
+        if (check == s)
+            break;
+
+        s = check;
+    }
+
+    snapshot = s;
+}
+
+HRTFDatabasePublisher::ReadScope::~ReadScope() noexcept
+{
+    publisher.hazard.store (nullptr, std::memory_order_release);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <JuceHeader.h>
+#include "HRTFDatabase.h"
+
+// Hands immutable HRTFDatabases from the loading side to the audio thread, RCU style.
+// A reload builds a complete new database and publishes it with one atomic pointer swap;
+// the audio thread pins the current one with a hazard pointer for the length of a block,
+// so it never locks, waits or frees anything. Replaced databases are kept on a retired
+// list and released from the message thread once the audio thread no longer holds them.
+//
+// There is exactly one reader: the audio thread. Writers may be any other thread.
+class HRTFDatabasePublisher : private juce::Timer
+{
+public:
+    HRTFDatabasePublisher();
+    ~HRTFDatabasePublisher() override;
+
+    // Replaces the current database (nullptr clears it).
+    void publish (std::shared_ptr<const HRTFDatabase> newDatabase);
+
+    // The newest published database, for the non-audio side (editor, state, ...).
+    std::shared_ptr<const HRTFDatabase> getLatest() const;
+
+private:
+    struct Snapshot
+    {
+        std::shared_ptr<const HRTFDatabase> database;
+        uint32_t version = 0;
+    };
+
+public:
+    // Audio thread only: keeps whatever is current alive while the scope exists.
+    class ReadScope
+    {
+    public:
+        explicit ReadScope (HRTFDatabasePublisher& p) noexcept;
+        ~ReadScope() noexcept;
+
+        const HRTFDatabase* get() const noexcept   { return snapshot->database.get(); }
+        uint32_t getVersion() const noexcept       { return snapshot->version; }
+
+    private:
+        HRTFDatabasePublisher& publisher;
+        const Snapshot* snapshot;
+
+        JUCE_DECLARE_NON_COPYABLE (ReadScope)
+    };
+
+private:
+    void timerCallback() override;
+    void collectRetired();
+
+    std::atomic<Snapshot*> current { nullptr };
+    std::atomic<const Snapshot*> hazard { nullptr };
+
+    juce::CriticalSection writeLock; // writers only, the audio thread never takes it
+    std::unique_ptr<Snapshot> currentOwner;
+    std::vector<std::unique_ptr<Snapshot>> retired;
+    uint32_t nextVersion = 1;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HRTFDatabasePublisher)
+};
@@ -0,0 +1,288 @@
+#include "HeadTracker.h"
+
+namespace {
+    static inline float wrap360 (float a) {
+        while (a < 0.0f) a += 360.0f;
+        while (a >= 360.0f) a -= 360.0f;
+        return a;
+    }
+
+    static inline int oscPaddedLength (const char* data, int maxLen) {
+        int len = 0;
+        while (len < maxLen && data[len] != 0) ++len;
+        return (len + 4) & ~3; // includes the terminator
+    }
+
+    static inline float readOscFloat (const char* p) {
+        uint32_t bits;
+        std::memcpy (&bits, p, 4);
+        bits = juce::ByteOrder::swapIfLittleEndian (bits);
+        float f;
+        std::memcpy (&f, &bits, 4);
+        return f;
+    }
+
+    // "/ypr ,fff <yaw> <pitch> <roll>" - other messages are ignored
+    static bool parseOscYpr (const char* data, int size, HeadPose& pose) {
+        const int addrLen = oscPaddedLength (data, size);
+        if (addrLen + 8 + 12 > size)
+            return false;
+
+        const juce::String address (juce::CharPointer_UTF8 (data), (size_t) juce::jmin (size, addrLen));
+        if (!address.endsWith ("ypr"))
+            return false;
+
+        const char* tags = data + addrLen;
+        if (std::strncmp (tags, ",fff", 4) != 0)
+            return false;
+
+        const char* args = tags + oscPaddedLength (tags, size - addrLen);
+        if (args + 12 > data + size)
+            return false;
+
+        pose.yaw   = readOscFloat (args);
+        pose.pitch = readOscFloat (args + 4);
+        pose.roll  = readOscFloat (args + 8);
+        return true;
+    }
+}
+
+//==============================================================================
+void HeadRotation::setPose (const HeadPose& pose)
+{
+    isIdentity = pose.yaw == 0.0f && pose.pitch == 0.0f && pose.roll == 0.0f;
+
+    const float cy = std::cos (juce::degreesToRadians (pose.yaw)),   sy = std::sin (juce::degreesToRadians (pose.yaw));
+    const float cp = std::cos (juce::degreesToRadians (pose.pitch)), sp = std::sin (juce::degreesToRadians (pose.pitch));
+    const float cr = std::cos (juce::degreesToRadians (pose.roll)),  sr = std::sin (juce::degreesToRadians (pose.roll));
+
+    // head orientation R = Rz(yaw) * Ry(-pitch) * Rx(roll), x front, y left, z up
+    const float rz[3][3] = { { cy, -sy, 0 }, { sy, cy, 0 }, { 0, 0, 1 } };
+    const float ry[3][3] = { { cp, 0, -sp }, { 0, 1, 0 }, { sp, 0, cp } };
+    const float rx[3][3] = { { 1, 0, 0 }, { 0, cr, -sr }, { 0, sr, cr } };
+
+    float tmp[3][3] {};
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            for (int k = 0; k < 3; ++k)
+                tmp[i][j] += rz[i][k] * ry[k][j];
+
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+        {
+            m[i][j] = 0.0f;
+            for (int k = 0; k < 3; ++k)
+                m[i][j] += tmp[i][k] * rx[k][j];
+        }
+}
+
+void HeadRotation::apply (float& azimuthDeg, float& elevationDeg) const noexcept
+{
+    if (isIdentity)
+        return;
+
+    const float a = juce::degreesToRadians (azimuthDeg);
+    const float e = juce::degreesToRadians (elevationDeg);
+    const float v[3] = { std::cos (e) * std::cos (a), std::cos (e) * std::sin (a), std::sin (e) };
+
+    // head-relative = R^T * world
+    float h[3];
+    for (int i = 0; i < 3; ++i)
+        h[i] = m[0][i] * v[0] + m[1][i] * v[1] + m[2][i] * v[2];
+
+    azimuthDeg = wrap360 (juce::radiansToDegrees (std::atan2 (h[1], h[0])));
+    elevationDeg = juce::radiansToDegrees (std::asin (juce::jlimit (-1.0f, 1.0f, h[2])));
+}
+
+//==============================================================================
+class HeadTracker::UdpReceiver : public juce::Thread
+{
+public:
+    UdpReceiver (HeadTracker& o, int p) : juce::Thread ("Head tracking OSC"), owner (o), port (p) {}
+
+    void run() override
+    {
+        juce::DatagramSocket socket;
+        if (!socket.bindToPort (port))
+        {
+            DBG("Head tracking: could not bind UDP port " << port);
+            return;
+        }
+
+        char data[512];
+
+        while (!threadShouldExit())
+        {
+            if (socket.waitUntilReady (true, 50) != 1)
+                continue;
+
+            const int n = socket.read (data, (int) sizeof (data), false);
+
+            HeadPose pose;
+            if (n > 0 && parseOscYpr (data, n, pose))
+            {
+                pose.receivedTicks = juce::Time::getHighResolutionTicks();
+                owner.push (pose);
+            }
+        }
+    }
+
+private:
+    HeadTracker& owner;
+    int port;
+};
+
+class HeadTracker::LoopbackGenerator : public juce::Thread
+{
+public:
+    explicit LoopbackGenerator (HeadTracker& o) : juce::Thread ("Head tracking loopback"), owner (o) {}
+
+    void run() override
+    {
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+
+        // 250 Hz, a +-45 degree yaw sweep every 4 seconds with a little nodding
+        while (!threadShouldExit())
+        {
+            const double t = (juce::Time::getMillisecondCounterHiRes() - start) * 0.001;
+
+            HeadPose pose;
+            pose.yaw = 45.0f * (float) std::sin (juce::MathConstants<double>::twoPi * 0.25 * t);
+            pose.pitch = 10.0f * (float) std::sin (juce::MathConstants<double>::twoPi * 0.5 * t);
+            pose.receivedTicks = juce::Time::getHighResolutionTicks();
+            owner.push (pose);
+
+            wait (4);
+        }
+    }
+
+private:
+    HeadTracker& owner;
+};
+
+//==============================================================================
+HeadTracker::HeadTracker() {}
+
+HeadTracker::~HeadTracker()
+{
+    stopTimer();
+    stopProducers();
+}
+
+void HeadTracker::attachToModeParameter (std::atomic<float>* modeParameter)
+{
+    modeParam = modeParameter;
+    startTimerHz (10);
+}
+
+void HeadTracker::setPort (int newPort)
+{
+    if (port == newPort)
+        return;
+
+    port = newPort;
+    if (activeMode.load() == Mode::osc)
+        startMode (Mode::osc);
+}
+
+void HeadTracker::timerCallback()
+{
+    if (modeParam == nullptr)
+        return;
+
+    const auto wanted = (Mode) juce::roundToInt (modeParam->load());
+    if (wanted != activeMode.load())
+        startMode (wanted);
+}
+
+void HeadTracker::stopProducers()
+{
+    if (producer != nullptr)
+        producer->stopThread (500);
+
+    producer.reset();
+}
+
+void HeadTracker::startMode (Mode mode)
+{
+    stopProducers();
+
+    if (mode == Mode::osc)
+        producer = std::make_unique<UdpReceiver> (*this, port);
+    else if (mode == Mode::loopback)
+        producer = std::make_unique<LoopbackGenerator> (*this);
+
+    if (producer != nullptr)
+        producer->startThread (juce::Thread::Priority::high);
+
+    resetLatencyStats();
+    activeMode = mode;
+}
+
+void HeadTracker::push (const HeadPose& pose) noexcept
+{
+    // if the audio thread isn't draining (e.g. transport stopped) just drop poses
+    const auto scope = fifo.write (1);
+    if (scope.blockSize1 > 0)
+        poses[(size_t) scope.startIndex1] = pose;
+}
+
+bool HeadTracker::pullLatest (HeadPose& pose) noexcept
+{
+    const int ready = fifo.getNumReady();
+    if (ready == 0)
+        return false;
+
+    {
+        const auto scope = fifo.read (ready);
+        pose = scope.blockSize2 > 0 ? poses[(size_t) (scope.startIndex2 + scope.blockSize2 - 1)]
+                                    : poses[(size_t) (scope.startIndex1 + scope.blockSize1 - 1)];
+    }
+
+    return true;
+}
+
+void HeadTracker::reportRendered (const HeadPose& pose, double secondsUntilOutput) noexcept
+{
+    const double render = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - pose.receivedTicks) * 1000.0;
+    const float output = (float) (render + secondsUntilOutput * 1000.0);
+
+    lastRenderLatencyMs = (float) render;
+    if ((float) render > worstRenderLatencyMs.load())
+        worstRenderLatencyMs = (float) render;
+
+    lastOutputLatencyMs = output;
+    if (output > worstOutputLatencyMs.load())
+        worstOutputLatencyMs = output;
+}
+
+bool HeadTracker::handleMidi (const juce::MidiBuffer& midi, int startSample, int endSample, HeadPose& pose) noexcept
+{
+    bool changed = false;
+
+    for (const auto metadata : midi)
+    {
+        if (metadata.samplePosition < startSample || metadata.samplePosition >= endSample)
+            continue;
+
+        const auto msg = metadata.getMessage();
+        if (!msg.isController())
+            continue;
+
+        const float norm = (float) msg.getControllerValue() / 127.0f;
+
+        switch (msg.getControllerNumber())
+        {
+            case yawCC:   pose.yaw   = norm * 360.0f - 180.0f; changed = true; break;
+            case pitchCC: pose.pitch = norm * 180.0f - 90.0f;  changed = true; break;
+            case rollCC:  pose.roll  = norm * 360.0f - 180.0f; changed = true; break;
+            default: break;
+        }
+    }
+
+    // CCs are already sample-aligned, so their render latency is at most one quantum
+    if (changed)
+        pose.receivedTicks = juce::Time::getHighResolutionTicks();
+
+    return changed;
+}
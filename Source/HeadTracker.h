@@ -0,0 +1,92 @@
+#pragma once
+#include <JuceHeader.h>
+
+struct HeadPose
+{
+    float yaw = 0.0f, pitch = 0.0f, roll = 0.0f; // degrees
+    juce::int64 receivedTicks = 0;               // Time::getHighResolutionTicks() when the pose arrived
+};
+
+// Turns world directions into head-relative ones (the inverse of the head rotation).
+// yaw + = head turns left, pitch + = head tilts up, roll + = head tilts towards the right shoulder
+struct HeadRotation
+{
+    void setPose (const HeadPose& pose);
+    void apply (float& azimuthDeg, float& elevationDeg) const noexcept;
+
+    bool isIdentity = true;
+    float m[3][3] { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+};
+
+// Head-tracking input. Poses come from one of:
+//  - OSC over UDP: "/ypr" (or any address ending in "ypr") with three floats, in degrees
+//  - MIDI CC 16 / 17 / 18 (yaw / pitch / roll) arriving in processBlock
+//  - a loopback generator that slowly sweeps the yaw, for testing without a tracker
+// Network and loopback poses are produced on their own thread and handed to the audio
+// thread through a single-producer / single-consumer FIFO; the audio thread never waits.
+class HeadTracker : private juce::Timer
+{
+public:
+    enum class Mode { off = 0, osc, midi, loopback };
+
+    static constexpr int defaultPort = 9000;
+    static constexpr int yawCC = 16, pitchCC = 17, rollCC = 18;
+
+    HeadTracker();
+    ~HeadTracker() override;
+
+    // The mode follows this choice parameter; the receiver threads are started/stopped from the message thread.
+    void attachToModeParameter (std::atomic<float>* modeParameter);
+    void setPort (int newPort);
+
+    // audio thread -------------------------------------------------------
+    Mode getActiveMode() const noexcept { return activeMode.load(); }
+
+    // Drains the FIFO and returns the newest pose, if any arrived since the last call.
+    bool pullLatest (HeadPose& pose) noexcept;
+
+    // Applies the CC messages in [startSample, endSample) to pose. Returns true if anything changed.
+    bool handleMidi (const juce::MidiBuffer& midi, int startSample, int endSample, HeadPose& pose) noexcept;
+
+    // Called with a pose the audio thread has just applied and how long until the first sample rendered
+    // with it leaves the host (FIFO position, engine latency and the host's buffer, see processQuantum).
+    void reportRendered (const HeadPose& pose, double secondsUntilOutput) noexcept;
+
+    // From a pose arriving here to the sub-block that rendered it. The audio thread reads the latest pose at
+    // every control sub-block (every quantum for virtual speakers), but a pose that arrives between callbacks
+    // still waits for the next one, so this is bounded by the host block, not by the sub-block.
+    float getLastRenderLatencyMs() const noexcept  { return lastRenderLatencyMs.load(); }
+    float getWorstRenderLatencyMs() const noexcept { return worstRenderLatencyMs.load(); }
+
+    // From a pose arriving here to the sound it steers leaving the plugin's host, i.e. the end-to-end figure
+    // without the tracker's own delay and the audio interface's converters / safety buffer.
+    float getLastOutputLatencyMs() const noexcept  { return lastOutputLatencyMs.load(); }
+    float getWorstOutputLatencyMs() const noexcept { return worstOutputLatencyMs.load(); }
+
+    void resetLatencyStats() noexcept { worstRenderLatencyMs = 0.0f; worstOutputLatencyMs = 0.0f; }
+
+    // producer side, used by the receiver threads
+    void push (const HeadPose& pose) noexcept;
+
+private:
+    class UdpReceiver;
+    class LoopbackGenerator;
+
+    void timerCallback() override;
+    void startMode (Mode mode);
+    void stopProducers();
+
+    std::atomic<float>* modeParam = nullptr;
+    std::atomic<Mode> activeMode { Mode::off };
+    int port = defaultPort;
+
+    juce::AbstractFifo fifo { 256 };
+    std::array<HeadPose, 256> poses;
+
+    std::unique_ptr<juce::Thread> producer;
+
+    std::atomic<float> lastRenderLatencyMs { 0.0f }, worstRenderLatencyMs { 0.0f };
+    std::atomic<float> lastOutputLatencyMs { 0.0f }, worstOutputLatencyMs { 0.0f };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HeadTracker)
+};
@@ -0,0 +1,251 @@
+#include "LevelOfDetail.h"
+
+//==============================================================================
+int LODGovernor::pickTier (float pressure, float levelDb) noexcept
+{
+    if (pressure <= 0.0f)
+        return LODVoice::full;
+
+    // from -30 dBFS down a source counts as quiet, at -60 dBFS it's a whole tier further down
+    const float quietness = juce::jlimit (0.0f, 1.0f, (-30.0f - levelDb) / 30.0f);
+    return juce::jlimit ((int) LODVoice::full, (int) LODVoice::gainOnly, (int) (pressure + quietness));
+}
+
+LODGovernor::Client::~Client()
+{
+    governor->totalLoad -= reported;
+}
+
+void LODGovernor::Client::reportLoad (double secondsSpent, double secondsAvailable) noexcept
+{
+    const float load = secondsAvailable > 0.0 ? (float) (secondsSpent / secondsAvailable) : 0.0f;
+    smoothedLoad += 0.1f * (load - smoothedLoad);
+
+    const auto mine = (juce::int64) (smoothedLoad * 1.0e6f);
+    const auto total = (governor->totalLoad += mine - reported);
+    reported = mine;
+
+    // the whole process over budget, or this instance close to missing its own deadline:
+    // back off fast (a tier in four quanta); recover slowly, so it doesn't pump
+    if (total > budget || smoothedLoad > 0.7f)
+        pressure = juce::jmin ((float) LODVoice::gainOnly, pressure + 0.25f);
+    else if (total < budget * 4 / 5 && smoothedLoad < 0.5f)
+        pressure = juce::jmax (0.0f, pressure - 0.005f);
+}
+
+//==============================================================================
+void LODVoice::prepare (double newSampleRate, int maxBlockSize)
+{
+    sampleRate = newSampleRate;
+    maxBlock = maxBlockSize;
+
+    line.assign ((size_t) (maxHistory + maxBlock), 0.0f);
+    scratchL.assign ((size_t) maxBlock, 0.0f);
+    scratchR.assign ((size_t) maxBlock, 0.0f);
+    fadeL.assign ((size_t) maxBlock, 0.0f);
+    fadeR.assign ((size_t) maxBlock, 0.0f);
+
+    // the same split the database measured the band gains with
+    shelfCoefficient = (float) std::exp (-juce::MathConstants<double>::twoPi * HRTFDatabase::shelfFrequency / sampleRate);
+
+    reset();
+}
+
+void LODVoice::reset()
+{
+    std::fill (line.begin(), line.end(), 0.0f);
+    shelfState[0] = shelfState[1] = 0.0f;
+
+    tier = fromTier = full;
+    fadeRemaining = 0;
+    pendingTier = -1;
+    fullTierStale = false;
+
+    // fade the next kernel in from silence
+    current = {};
+    previous = {};
+    changed = false;
+    kernelIndex = -1;
+}
+
+void LODVoice::lockInMemory (MemoryLock::Set& set) const
+{
+    for (auto* v : { &line, &scratchL, &scratchR, &fadeL, &fadeR })
+        set.add (v->data(), v->size() * sizeof (float));
+}
+
+void LODVoice::setTier (int newTier) noexcept
+{
+    // fading would have to drop the tier that's fading out, and that clicks
+    if (fadeRemaining > 0)
+    {
+        pendingTier = newTier != tier ? newTier : -1;
+        return;
+    }
+
+    pendingTier = -1;
+
+    if (newTier == tier)
+        return;
+
+    // shelving starts from the signal, not from wherever its filter was left
+    if (newTier == shelving)
+        shelfState[0] = shelfState[1] = 0.0f;
+
+    fromTier = tier;
+    tier = newTier;
+    fadeRemaining = fadeLength;
+}
+
+void LODVoice::setKernel (const HRTFDatabase& db, int index)
+{
+    if (index < 0 || index == kernelIndex || !db.hasLevelsOfDetail())
+        return;
+
+    // a second change before the block ran keeps fading from what was actually playing
+    if (!changed)
+        previous = current;
+
+    current.length = juce::jmin (db.getMinimumPhaseLength(), maxFilterLength);
+    std::copy (db.getMinimumPhaseIR (index, 0), db.getMinimumPhaseIR (index, 0) + current.length, current.filterL.begin());
+    std::copy (db.getMinimumPhaseIR (index, 1), db.getMinimumPhaseIR (index, 1) + current.length, current.filterR.begin());
+
+    for (int ear = 0; ear < 2; ++ear)
+    {
+        current.delays[ear] = juce::jmin (db.getOnsetDelay (index, ear), maxDelay);
+        std::copy (db.getBandGains (index, ear), db.getBandGains (index, ear) + 3, current.gains[ear]);
+    }
+
+    kernelIndex = index;
+    changed = true;
+}
+
+void LODVoice::renderFilter (const Parameters& p, float* outL, float* outR, int numSamples)
+{
+    const float* x = line.data() + maxHistory;
+
+    // y[s] = sum h[k] x[s - delay - k], one SIMD multiply-add per tap
+    juce::FloatVectorOperations::clear (outL, numSamples);
+    juce::FloatVectorOperations::clear (outR, numSamples);
+
+    for (int k = 0; k < p.length; ++k)
+    {
+        juce::FloatVectorOperations::addWithMultiply (outL, x - p.delays[0] - k, p.filterL[(size_t) k], numSamples);
+        juce::FloatVectorOperations::addWithMultiply (outR, x - p.delays[1] - k, p.filterR[(size_t) k], numSamples);
+    }
+}
+
+void LODVoice::render (int which, PartitionedConvolver& fullTier, float* outL, float* outR, int numSamples)
+{
+    const float* x = line.data() + maxHistory;
+    const auto& from = changed ? previous : current;
+    float* outs[2] = { outL, outR };
+
+    switch (which)
+    {
+        case full:
+            // It missed input while a lower tier played. Refilled from this voice's own history it comes back
+            // with its whole tail, not one that's cut off and fades in over the next IR length.
+            if (fullTierStale)
+            {
+                const int refill = juce::jmin (fullTier.getKernelLength(), maxHistory);
+
+                fullTier.clearHistory();
+                fullTier.pushHistory (x - refill, refill);
+                fullTierStale = false;
+            }
+
+            fullTier.process (x, outL, outR, numSamples);
+            break;
+
+        case minimumPhase:
+            renderFilter (current, outL, outR, numSamples);
+
+            if (changed)
+            {
+                renderFilter (previous, scratchL.data(), scratchR.data(), numSamples);
+
+                for (int s = 0; s < numSamples; ++s)
+                {
+                    const float t = ((float) s + 0.5f) / (float) numSamples;
+                    outL[s] = scratchL[(size_t) s] + t * (outL[s] - scratchL[(size_t) s]);
+                    outR[s] = scratchR[(size_t) s] + t * (outR[s] - scratchR[(size_t) s]);
+                }
+            }
+            break;
+
+        case shelving:
+            for (int ear = 0; ear < 2; ++ear)
+            {
+                auto* out = outs[ear];
+                const int oldDelay = from.delays[ear], newDelay = current.delays[ear];
+                float state = shelfState[ear];
+
+                for (int s = 0; s < numSamples; ++s)
+                {
+                    const float t = ((float) s + 0.5f) / (float) numSamples;
+                    const float a = x[s - oldDelay], b = x[s - newDelay];
+                    const float in = a + t * (b - a);
+
+                    state = in + shelfCoefficient * (state - in);
+                    const float low = from.gains[ear][0] + t * (current.gains[ear][0] - from.gains[ear][0]);
+                    const float high = from.gains[ear][1] + t * (current.gains[ear][1] - from.gains[ear][1]);
+                    out[s] = low * state + high * (in - state);
+                }
+
+                shelfState[ear] = state;
+            }
+            break;
+
+        case gainOnly:
+        default:
+            for (int ear = 0; ear < 2; ++ear)
+            {
+                auto* out = outs[ear];
+                const float start = from.gains[ear][2];
+                const float delta = current.gains[ear][2] - start;
+
+                for (int s = 0; s < numSamples; ++s)
+                    out[s] = x[s] * (start + delta * ((float) s + 0.5f) / (float) numSamples);
+            }
+            break;
+    }
+}
+
+void LODVoice::process (PartitionedConvolver& fullTier, const float* input, float* outL, float* outR, int numSamples)
+{
+    jassert (numSamples <= maxBlock);
+
+    if (fadeRemaining == 0 && pendingTier >= 0)
+        setTier (pendingTier);
+
+    // input before output, they may be the same memory
+    std::copy (input, input + numSamples, line.begin() + maxHistory);
+
+    const bool fading = fadeRemaining > 0;
+    const bool fullHeard = tier == full || (fading && fromTier == full);
+
+    render (tier, fullTier, outL, outR, numSamples);
+
+    if (fading)
+    {
+        render (fromTier, fullTier, fadeL.data(), fadeR.data(), numSamples);
+
+        const int done = fadeLength - fadeRemaining;
+        for (int s = 0; s < numSamples; ++s)
+        {
+            const float t = juce::jmin (1.0f, ((float) (done + s) + 0.5f) / (float) fadeLength);
+            outL[s] = fadeL[(size_t) s] + t * (outL[s] - fadeL[(size_t) s]);
+            outR[s] = fadeR[(size_t) s] + t * (outR[s] - fadeR[(size_t) s]);
+        }
+
+        fadeRemaining = juce::jmax (0, fadeRemaining - numSamples);
+    }
+
+    // skipped the convolver: it has a gap in its input now
+    if (!fullHeard)
+        fullTierStale = true;
+
+    changed = false;
+    std::copy (line.begin() + numSamples, line.begin() + numSamples + maxHistory, line.begin());
+}
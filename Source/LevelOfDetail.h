@@ -0,0 +1,121 @@
+#pragma once
+#include <JuceHeader.h>
+#include "HRTFDatabase.h"
+#include "PartitionedConvolver.h"
+
+// Graceful degradation for heavily loaded sessions: every source is rendered at one of four
+// quality tiers, picked per quantum from how loud it is and how busy the whole process is.
+//
+//  full          - the full-length HRIR convolution
+//  minimumPhase  - a short minimum-phase FIR plus the onset delay (the ITD) it lost
+//  shelving      - onset delay + one low / high band gain per ear (ILD as a shelf)
+//  gainOnly      - one gain per ear, no delay
+//
+// The lower tiers read the HRTFDatabase's levels of detail (buildLevelsOfDetail) and cost
+// a fraction of the full tier. Tier changes are crossfaded over one fadeLength.
+
+// Process-wide CPU budget. Every instance reports how long its quanta take against the real
+// time they cover; while the sum is over budget the pressure (0 = full quality .. 3) climbs
+// quickly, and it only comes back down slowly once there is headroom again.
+class LODGovernor
+{
+public:
+    // share of the machine's real time all instances together should stay under
+    static constexpr float budgetPerCore = 0.5f;
+
+    class Client;
+
+    // Tier for a source at levelDb (dBFS of its input) under `pressure`. Quiet sources go down first.
+    static int pickTier (float pressure, float levelDb) noexcept;
+
+private:
+    // summed load of all clients, in millionths of one core's real time
+    std::atomic<juce::int64> totalLoad { 0 };
+};
+
+// One instance's share of the budget, registered for as long as it exists.
+class LODGovernor::Client
+{
+public:
+    Client() = default;
+    ~Client();
+
+    // audio thread: after each quantum
+    void reportLoad (double secondsSpent, double secondsAvailable) noexcept;
+    float getPressure() const noexcept { return pressure; }
+
+private:
+    juce::SharedResourcePointer<LODGovernor> governor;
+    const juce::int64 budget = (juce::int64) (budgetPerCore * (float) juce::SystemStats::getNumCpus() * 1.0e6f);
+    juce::int64 reported = 0;
+    float smoothedLoad = 0.0f, pressure = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Client)
+};
+
+// One source at a changing tier. The input history is always kept, so any tier can take over
+// between two quanta; the full tier's convolver is owned by the caller and only fed while it's heard,
+// then refilled from that history (forward FFTs only) when it's heard again.
+class LODVoice
+{
+public:
+    enum Tier { full, minimumPhase, shelving, gainOnly, numTiers };
+
+    static constexpr int fadeLength = 128;
+    static constexpr int maxFilterLength = 256;
+
+    void prepare (double sampleRate, int maxBlockSize);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const;
+
+    // At quantum boundaries; a change is crossfaded over the next fadeLength samples. One asked for while
+    // a crossfade is still running waits for it to finish (the newest one wins), so no tier is cut off mid-fade.
+    void setTier (int newTier) noexcept;
+    int getTier() const noexcept { return tier; }
+
+    // nothing left of a lower tier, the caller can go back to running the convolver directly
+    bool isAtFullQuality() const noexcept { return tier == full && fadeRemaining == 0 && pendingTier < 0; }
+
+    // The reduced data of IR `index`; changes are crossfaded / ramped over the next process() call.
+    void setKernel (const HRTFDatabase& db, int index);
+
+    // the next setKernel() is taken even with the same index, it's from another database now
+    void invalidateKernel() noexcept { kernelIndex = -1; }
+
+    // mono in, both ears out; input may alias outL
+    void process (PartitionedConvolver& fullTier, const float* input, float* outL, float* outR, int numSamples);
+
+private:
+    struct Parameters
+    {
+        std::array<float, maxFilterLength> filterL {}, filterR {};
+        int length = 0;
+        int delays[2] = {};
+        float gains[2][3] = {}; // [ear][low, high, broadband]
+    };
+
+    void render (int which, PartitionedConvolver& fullTier, float* outL, float* outR, int numSamples);
+    void renderFilter (const Parameters& p, float* outL, float* outR, int numSamples);
+
+    double sampleRate = 44100.0;
+    int maxBlock = 0;
+
+    int tier = full, fromTier = full, fadeRemaining = 0;
+    int pendingTier = -1; // asked for mid-fade, taken once the fade is done
+    bool fullTierStale = false; // the convolver missed some input, its history has to be refilled
+
+    Parameters current, previous;
+    bool changed = false;
+    int kernelIndex = -1;
+
+    // mono input: maxHistory samples of the past, then the block being rendered
+    static constexpr int maxDelay = 1024;
+    static constexpr int maxHistory = maxDelay + maxFilterLength;
+    std::vector<float> line;
+    std::vector<float> scratchL, scratchR, fadeL, fadeR;
+
+    float shelfCoefficient = 0.0f;
+    float shelfState[2] = {};
+};
@@ -0,0 +1,219 @@
+#include "MemoryLock.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <sys/mman.h>
+ #include <sys/resource.h>
+ #include <unistd.h>
+#endif
+
+namespace {
+    struct Region
+    {
+        size_t numBytes = 0;
+        int users = 0;
+        bool locked = false;
+    };
+
+    struct Registry
+    {
+        juce::CriticalSection lock;
+        std::map<const void*, Region> regions;
+        // Locked regions per page. mlock / VirtualLock don't nest, so a page shared by two regions
+        // (the tail of one allocation, the head of the next) may only be unlocked when both are gone.
+        std::map<uintptr_t, int> pages;
+        size_t ceiling = 0;
+    };
+
+    static Registry& getRegistry() {
+        static Registry registry;
+        return registry;
+    }
+
+    static size_t getPageSize() {
+       #if JUCE_WINDOWS
+        SYSTEM_INFO info;
+        GetSystemInfo (&info);
+        return (size_t) info.dwPageSize;
+       #else
+        return (size_t) sysconf (_SC_PAGESIZE);
+       #endif
+    }
+
+    // one read per page brings everything in, whether it was never touched or has been paged out
+    static void prefault (const void* data, size_t numBytes) {
+        static const size_t pageSize = getPageSize();
+        const auto* p = static_cast<const volatile char*> (data);
+
+        for (size_t offset = 0; offset < numBytes; offset += pageSize)
+            (void) p[offset];
+
+        if (numBytes > 0)
+            (void) p[numBytes - 1];
+    }
+
+    // every page the region touches, its ends included: [first, end)
+    struct PageRange { uintptr_t first, end; };
+
+    static PageRange getPages (const void* data, size_t numBytes) {
+        static const uintptr_t pageSize = getPageSize();
+        const auto start = reinterpret_cast<uintptr_t> (data);
+        return { start & ~(pageSize - 1), (start + numBytes + pageSize - 1) & ~(pageSize - 1) };
+    }
+
+    static bool lockPages (uintptr_t start, size_t numBytes) {
+       #if JUCE_WINDOWS
+        return VirtualLock (reinterpret_cast<void*> (start), numBytes) != 0;
+       #else
+        return mlock (reinterpret_cast<const void*> (start), numBytes) == 0;
+       #endif
+    }
+
+    static void unlockPages (uintptr_t start, size_t numBytes) {
+       #if JUCE_WINDOWS
+        VirtualUnlock (reinterpret_cast<void*> (start), (SIZE_T) numBytes);
+       #else
+        munlock (reinterpret_cast<const void*> (start), numBytes);
+       #endif
+    }
+
+    // unlocks the pages in the range no locked region uses any more, a run of them at a time
+    static void unlockUnusedPages (const Registry& registry, PageRange range) {
+        static const uintptr_t pageSize = getPageSize();
+        uintptr_t runStart = range.first;
+
+        for (auto page = range.first; page <= range.end; page += pageSize)
+        {
+            if (page < range.end && registry.pages.count (page) == 0)
+                continue;
+
+            if (page > runStart)
+                unlockPages (runStart, (size_t) (page - runStart));
+
+            runStart = page + pageSize;
+        }
+    }
+
+    // locks the region's pages if what they add stays under the ceiling
+    static bool lockRegion (Registry& registry, const void* data, size_t numBytes) {
+        static const uintptr_t pageSize = getPageSize();
+        const auto range = getPages (data, numBytes);
+
+        size_t newPages = 0;
+        for (auto page = range.first; page < range.end; page += pageSize)
+            newPages += registry.pages.count (page) == 0 ? 1 : 0;
+
+        if ((registry.pages.size() + newPages) * pageSize > registry.ceiling)
+            return false;
+
+        if (!lockPages (range.first, (size_t) (range.end - range.first)))
+        {
+            // a refused mlock can still have locked some of them
+            unlockUnusedPages (registry, range);
+            return false;
+        }
+
+        for (auto page = range.first; page < range.end; page += pageSize)
+            ++registry.pages[page];
+
+        return true;
+    }
+
+    static void unlockRegion (Registry& registry, const void* data, size_t numBytes) {
+        static const uintptr_t pageSize = getPageSize();
+        const auto range = getPages (data, numBytes);
+
+        for (auto page = range.first; page < range.end; page += pageSize)
+        {
+            const auto it = registry.pages.find (page);
+            if (it != registry.pages.end() && --it->second == 0)
+                registry.pages.erase (it);
+        }
+
+        unlockUnusedPages (registry, range);
+    }
+}
+
+void MemoryLock::setCeiling (size_t bytes)
+{
+    auto& registry = getRegistry();
+    const juce::ScopedLock sl (registry.lock);
+    registry.ceiling = bytes;
+}
+
+size_t MemoryLock::getCeiling()
+{
+    auto& registry = getRegistry();
+    const juce::ScopedLock sl (registry.lock);
+    return registry.ceiling;
+}
+
+size_t MemoryLock::getLockedBytes()
+{
+    auto& registry = getRegistry();
+    const juce::ScopedLock sl (registry.lock);
+    return registry.pages.size() * getPageSize();
+}
+
+juce::int64 MemoryLock::getMajorFaults() noexcept
+{
+   #if JUCE_LINUX || JUCE_BSD
+    rusage usage;
+    return getrusage (RUSAGE_THREAD, &usage) == 0 ? (juce::int64) usage.ru_majflt : -1;
+   #elif JUCE_MAC
+    rusage usage;
+    return getrusage (RUSAGE_SELF, &usage) == 0 ? (juce::int64) usage.ru_majflt : -1;
+   #else
+    return -1;
+   #endif
+}
+
+//==============================================================================
+bool MemoryLock::Set::add (const void* data, size_t numBytes)
+{
+    if (data == nullptr || numBytes == 0)
+        return false;
+
+    auto& registry = getRegistry();
+    const juce::ScopedLock sl (registry.lock);
+
+    auto& region = registry.regions[data];
+
+    if (region.users++ == 0)
+    {
+        region.numBytes = numBytes;
+        prefault (data, numBytes);
+
+        region.locked = lockRegion (registry, data, numBytes);
+    }
+
+    regions.push_back (data);
+    requestedBytes += numBytes;
+    lockedBytes += region.locked ? numBytes : 0;
+    return region.locked;
+}
+
+void MemoryLock::Set::clear()
+{
+    if (regions.empty())
+        return;
+
+    auto& registry = getRegistry();
+    const juce::ScopedLock sl (registry.lock);
+
+    for (auto* data : regions)
+    {
+        const auto it = registry.regions.find (data);
+        if (it == registry.regions.end() || --it->second.users > 0)
+            continue;
+
+        if (it->second.locked)
+            unlockRegion (registry, data, it->second.numBytes);
+
+        registry.regions.erase (it);
+    }
+
+    regions.clear();
+    requestedBytes = lockedBytes = 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Keeps memory the audio thread reads resident, so a rarely used direction can't page-fault
+// inside a callback: every page is touched once (prefaulted) and then locked (mlock / VirtualLock)
+// while a process-wide ceiling allows it. Past the ceiling, or if the OS refuses (RLIMIT_MEMLOCK,
+// the Windows working set), a region is only prefaulted.
+//
+// Regions are reference counted by their start address, so instances sharing one database lock
+// it once and the last one to let go unlocks it. Pages are counted too: one shared by two regions
+// stays locked until both are released. Message / loader threads only.
+class MemoryLock
+{
+public:
+    // What all instances together may lock, in bytes. Process-wide; the last caller sets it.
+    static void setCeiling (size_t bytes);
+    static size_t getCeiling();
+
+    // locked right now, process-wide, in whole pages
+    static size_t getLockedBytes();
+
+    // Major (disk) page faults so far: of the calling thread on Linux, of the whole process on macOS
+    // (an upper bound then), -1 where the platform can't tell. Cheap enough for once per callback.
+    static juce::int64 getMajorFaults() noexcept;
+
+    // The regions one owner holds, released together on clear() or destruction.
+    class Set
+    {
+    public:
+        Set() = default;
+        ~Set() { clear(); }
+
+        // Prefaults [data, data + numBytes) and locks it if the ceiling allows; true if it's locked.
+        bool add (const void* data, size_t numBytes);
+        void clear();
+
+        // what this set asked for / what of it ended up locked
+        size_t getRequestedBytes() const noexcept { return requestedBytes; }
+        size_t getLockedBytes() const noexcept    { return lockedBytes; }
+
+    private:
+        std::vector<const void*> regions;
+        size_t requestedBytes = 0, lockedBytes = 0;
+
+        JUCE_DECLARE_NON_COPYABLE (Set)
+    };
+};
@@ -0,0 +1,379 @@
+#include "PartitionedConvolver.h"
+#include "HRTFDatabase.h"
+
+namespace {
+    constexpr size_t alignment = 64;
+
+    static_assert (PartitionedConvolver::Transform::getBinStride (1) * sizeof (float) == alignment, "a bin stride has to be whole cache lines");
+
+    constexpr int binStrideFor (int partitionSize) {
+        return PartitionedConvolver::Transform::getBinStride (partitionSize);
+    }
+
+    // Both ears' older partitions: tail[ear] = sum over p >= 1 of fdl[head - p] * kernel[ear][p].
+    // Each delay line slot is read once for both ears.
+    static forcedinline void accumulateTails (const float* fdl, int fdlHead, const float* kernel, float* tail,
+                                              int numPartitions, int binStride, int maxPartitions) {
+        const int spectrumFloats = 2 * binStride;
+        std::fill (tail, tail + 2 * spectrumFloats, 0.0f);
+
+        for (int p = 1; p < numPartitions; ++p)
+        {
+            const float* slot = fdl + (size_t) ((fdlHead - p + maxPartitions) % maxPartitions) * (size_t) spectrumFloats;
+
+            for (int ear = 0; ear < 2; ++ear)
+                PartitionedConvolver::complexMultiplyAccumulate (slot, kernel + (size_t) (ear * maxPartitions + p) * (size_t) spectrumFloats,
+                                                                 tail + ear * spectrumFloats, binStride);
+        }
+    }
+
+    // The same loops with every size a compile-time constant, so they unroll and the offsets fold.
+    // The run-time size arguments are only there to share the generic versions' signatures.
+    template <int partitionSize>
+    static void multiplyAccumulateFixed (const float* a, const float* b, float* acc, int) {
+        PartitionedConvolver::complexMultiplyAccumulate (a, b, acc, binStrideFor (partitionSize));
+    }
+
+    template <int partitionSize, int numPartitions>
+    static void accumulateTailsFixed (const float* fdl, int fdlHead, const float* kernel, float* tail, int, int, int) {
+        accumulateTails (fdl, fdlHead, kernel, tail, numPartitions, binStrideFor (partitionSize),
+                         PartitionedConvolver::maxKernelLength / partitionSize);
+    }
+
+    static void multiplyAccumulateGeneric (const float* a, const float* b, float* acc, int n) {
+        PartitionedConvolver::complexMultiplyAccumulate (a, b, acc, n);
+    }
+
+    static void accumulateTailsGeneric (const float* fdl, int fdlHead, const float* kernel, float* tail,
+                                        int numPartitions, int binStride, int maxPartitions) {
+        accumulateTails (fdl, fdlHead, kernel, tail, numPartitions, binStride, maxPartitions);
+    }
+
+    // 2, 4 .. 32 partitions: 256 / 512 / 1024 tap IRs at every partition size from 32 to 512.
+    // A single partition has no tail, only the clear, so there's nothing to unroll
+    template <int partitionSize>
+    static void selectVariants (PartitionedConvolver::MultiplyAccumulate& multiply,
+                                std::array<PartitionedConvolver::TailAccumulate, PartitionedConvolver::numTailVariants>& tails) {
+        multiply = multiplyAccumulateFixed<partitionSize>;
+        tails = { accumulateTailsGeneric,                  accumulateTailsFixed<partitionSize, 2>,
+                  accumulateTailsFixed<partitionSize, 4>,  accumulateTailsFixed<partitionSize, 8>,
+                  accumulateTailsFixed<partitionSize, 16>, accumulateTailsFixed<partitionSize, 32> };
+    }
+}
+
+void PartitionedConvolver::prepare (int maxBlockSize, bool specialisedLoops)
+{
+    partitionSize = juce::nextPowerOfTwo (juce::jlimit (minPartitionSize, maxPartitionSize, maxBlockSize));
+    fftSize = 2 * partitionSize;
+
+    binStride = binStrideFor (partitionSize);
+    maxPartitions = (maxKernelLength + partitionSize - 1) / partitionSize;
+
+    // the sizes are fixed from here on, so pick the inner loops compiled for them
+    switch (specialisedLoops ? partitionSize : 0)
+    {
+        case 32:  selectVariants<32>  (multiplyAccumulate, tailVariants); break;
+        case 64:  selectVariants<64>  (multiplyAccumulate, tailVariants); break;
+        case 128: selectVariants<128> (multiplyAccumulate, tailVariants); break;
+        case 256: selectVariants<256> (multiplyAccumulate, tailVariants); break;
+        case 512: selectVariants<512> (multiplyAccumulate, tailVariants); break;
+        default:
+            multiplyAccumulate = multiplyAccumulateGeneric;
+            tailVariants.fill (accumulateTailsGeneric);
+            break;
+    }
+
+    const size_t spectrumFloats = 2 * (size_t) binStride;
+    const size_t kernelSetFloats = 2 * (size_t) maxPartitions * spectrumFloats;
+
+    const size_t fdlFloats = (size_t) maxPartitions * spectrumFloats;
+    const size_t total = fdlFloats + (3 + numStagedKernels) * kernelSetFloats + (size_t) fftSize + 2 * (size_t) fftSize
+                         + 4 * spectrumFloats + spectrumFloats;
+
+    storage.assign (total + alignment / sizeof (float), 0.0f);
+
+    auto* p = reinterpret_cast<float*> ((reinterpret_cast<uintptr_t> (storage.data()) + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    auto carve = [&p] (size_t numFloats) { auto* start = p; p += numFloats; return start; };
+
+    fdl = carve (fdlFloats);
+    current.data = carve (kernelSetFloats);
+    previous.data = carve (kernelSetFloats);
+    next.data = carve (kernelSetFloats);
+    for (auto& slot : staged)
+        slot.data = carve (kernelSetFloats);
+    frame = carve ((size_t) fftSize);
+    fftBuffer = carve (2 * (size_t) fftSize);
+    tails = carve (4 * spectrumFloats);
+    acc = carve (spectrumFloats);
+
+    transform.prepare (partitionSize, fftBuffer);
+    reset();
+}
+
+void PartitionedConvolver::reset()
+{
+    std::fill (fdl, fdl + (size_t) maxPartitions * 2 * (size_t) binStride, 0.0f);
+    std::fill (frame, frame + fftSize, 0.0f);
+    fdlHead = 0;
+    framePos = 0;
+
+    // fade the next kernel in from silence
+    current.numPartitions = previous.numPartitions = 0;
+
+    // ids are only meaningful for one database
+    current.id = previous.id = next.id = -1;
+    for (auto& slot : staged)
+        slot.id = -1;
+    kernelPending = fading = false;
+}
+
+void PartitionedConvolver::clearHistory()
+{
+    std::fill (fdl, fdl + (size_t) maxPartitions * 2 * (size_t) binStride, 0.0f);
+    std::fill (frame, frame + fftSize, 0.0f);
+    fdlHead = 0;
+    framePos = 0;
+
+    if (kernelPending)
+    {
+        std::swap (previous, current);
+        std::swap (current, next);
+        kernelPending = false;
+    }
+
+    fading = false;
+}
+
+void PartitionedConvolver::pushHistory (const float* input, int numSamples)
+{
+    for (int written = 0; written < numSamples;)
+    {
+        const int chunk = juce::jmin (numSamples - written, partitionSize - framePos);
+
+        std::copy (input + written, input + written + chunk, frame + partitionSize + framePos);
+        framePos += chunk;
+        written += chunk;
+
+        // only whole partitions go into the delay line here, process() transforms the one it's in anyway
+        if (framePos == partitionSize)
+        {
+            transform.forward (frame, fftSize, delayLineSlot (fdlHead));
+
+            std::copy (frame + partitionSize, frame + fftSize, frame);
+            std::fill (frame + partitionSize, frame + fftSize, 0.0f);
+            fdlHead = (fdlHead + 1) % maxPartitions;
+            framePos = 0;
+        }
+    }
+
+    // stopped inside a partition: process() won't start one, so the older partitions are summed here
+    if (framePos > 0)
+    {
+        accumulateTail (current, tails);
+        if (fading)
+            accumulateTail (previous, spectrum (tails, 2));
+    }
+}
+
+void PartitionedConvolver::invalidateKernels() noexcept
+{
+    current.id = previous.id = next.id = -1;
+    for (auto& slot : staged)
+        slot.id = -1;
+}
+
+//==============================================================================
+void PartitionedConvolver::Transform::prepare (int newPartitionSize, float* buffer)
+{
+    partitionSize = newPartitionSize;
+    fftSize = 2 * partitionSize;
+    binStride = getBinStride (partitionSize);
+    fft = std::make_unique<juce::dsp::FFT> (juce::roundToInt (std::log2 (fftSize)));
+    fftBuffer = buffer;
+}
+
+void PartitionedConvolver::Transform::forward (const float* src, int length, float* dst) const noexcept
+{
+    std::fill (fftBuffer, fftBuffer + 2 * fftSize, 0.0f);
+    std::copy (src, src + length, fftBuffer);
+    fft->performRealOnlyForwardTransform (fftBuffer, true);
+
+    float* im = dst + binStride;
+    for (int k = 0; k <= partitionSize; ++k)
+    {
+        dst[k] = fftBuffer[2 * k];
+        im[k]  = fftBuffer[2 * k + 1];
+    }
+}
+
+void PartitionedConvolver::Transform::inverse (const float* src, float* dst, int offset, int numSamples) const noexcept
+{
+    const float* im = src + binStride;
+    for (int k = 0; k <= partitionSize; ++k)
+    {
+        fftBuffer[2 * k]     = src[k];
+        fftBuffer[2 * k + 1] = im[k];
+    }
+
+    fft->performRealOnlyInverseTransform (fftBuffer);
+
+    // overlap-save: the second half is the valid part
+    std::copy (fftBuffer + partitionSize + offset, fftBuffer + partitionSize + offset + numSamples, dst);
+}
+
+int PartitionedConvolver::Transform::transformKernel (const float* left, const float* right, int length, int maxPartitions, float* dst) const noexcept
+{
+    length = juce::jmin (length, maxPartitions * partitionSize);
+
+    // same level as juce::dsp::Convolution with Normalise::yes, which the make-up gain was set against
+    const float gain = HRTFDatabase::getKernelGain (left, right, length);
+    const int numPartitions = (length + partitionSize - 1) / partitionSize;
+
+    for (int ear = 0; ear < 2; ++ear)
+    {
+        const float* ir = ear == 0 ? left : right;
+
+        for (int p = 0; p < numPartitions; ++p)
+        {
+            auto* spectrum = dst + (size_t) (ear * maxPartitions + p) * 2 * (size_t) binStride;
+
+            forward (ir + p * partitionSize, juce::jmin (partitionSize, length - p * partitionSize), spectrum);
+            juce::FloatVectorOperations::multiply (spectrum, gain, 2 * binStride);
+        }
+    }
+
+    return numPartitions;
+}
+
+//==============================================================================
+void PartitionedConvolver::transformKernel (KernelSet& set, int id, const float* left, const float* right, int length)
+{
+    set.numPartitions = transform.transformKernel (left, right, length, maxPartitions, set.data);
+
+    // IR lengths are fixed per database: a power-of-two partition count gets its unrolled tail
+    const int variant = juce::roundToInt (std::log2 (set.numPartitions));
+    set.accumulateTails = juce::isPowerOfTwo (set.numPartitions) && variant < numTailVariants ? tailVariants[(size_t) variant]
+                                                                                               : accumulateTailsGeneric;
+
+    set.id = id;
+}
+
+void PartitionedConvolver::setKernel (int id, const float* left, const float* right, int length)
+{
+    if (id >= 0 && (kernelPending ? next.id == id : current.id == id))
+        return;
+
+    for (auto& slot : staged)
+    {
+        if (id >= 0 && slot.id == id)
+        {
+            // staged ahead of time, just take it over
+            std::swap (next, slot);
+            slot.id = -1;
+            kernelPending = true;
+            return;
+        }
+    }
+
+    transformKernel (next, id, left, right, length);
+    kernelPending = true;
+}
+
+void PartitionedConvolver::prestageKernel (int id, const float* left, const float* right, int length)
+{
+    if (id < 0 || current.id == id || (kernelPending && next.id == id))
+        return;
+
+    for (auto& slot : staged)
+        if (slot.id == id)
+            return;
+
+    auto& slot = staged[(size_t) nextStagedSlot];
+    nextStagedSlot = (nextStagedSlot + 1) % numStagedKernels;
+    transformKernel (slot, id, left, right, length);
+}
+
+void PartitionedConvolver::accumulateTail (const KernelSet& set, float* tail)
+{
+    if (set.numPartitions == 0)
+    {
+        std::fill (tail, tail + 4 * binStride, 0.0f);
+        return;
+    }
+
+    set.accumulateTails (fdl, fdlHead, set.data, tail, set.numPartitions, binStride, maxPartitions);
+}
+
+void PartitionedConvolver::startPartition()
+{
+    if (kernelPending)
+    {
+        // rotate the sets, nothing is copied
+        std::swap (previous, current);
+        std::swap (current, next);
+        kernelPending = false;
+        fading = true;
+    }
+
+    // everything older than the current partition only has to be summed once
+    accumulateTail (current, tails);
+
+    if (fading)
+        accumulateTail (previous, spectrum (tails, 2));
+}
+
+void PartitionedConvolver::process (const float* input, float* outL, float* outR, int numSamples)
+{
+    float* outs[2] = { outL, outR };
+
+    for (int written = 0; written < numSamples;)
+    {
+        const int chunk = juce::jmin (numSamples - written, partitionSize - framePos);
+
+        if (framePos == 0)
+            startPartition();
+
+        // input before output, they may be the same memory
+        std::copy (input + written, input + written + chunk, frame + partitionSize + framePos);
+        transform.forward (frame, fftSize, delayLineSlot (fdlHead));
+
+        for (int ear = 0; ear < 2; ++ear)
+        {
+            auto* out = outs[ear] + written;
+
+            std::copy (spectrum (tails, ear), spectrum (tails, ear) + 2 * binStride, acc);
+            if (current.numPartitions > 0)
+                multiplyAccumulate (delayLineSlot (fdlHead), kernelSpectrum (current, ear, 0), acc, binStride);
+
+            transform.inverse (acc, out, framePos, chunk);
+
+            if (fading)
+            {
+                // the old kernel's output lands at the start of fftBuffer
+                std::copy (spectrum (tails, 2 + ear), spectrum (tails, 2 + ear) + 2 * binStride, acc);
+                if (previous.numPartitions > 0)
+                    multiplyAccumulate (delayLineSlot (fdlHead), kernelSpectrum (previous, ear, 0), acc, binStride);
+
+                transform.inverse (acc, fftBuffer, framePos, chunk);
+
+                for (int s = 0; s < chunk; ++s)
+                {
+                    const float t = ((float) (framePos + s) + 0.5f) / (float) partitionSize;
+                    out[s] = fftBuffer[s] + t * (out[s] - fftBuffer[s]);
+                }
+            }
+        }
+
+        framePos += chunk;
+        written += chunk;
+
+        if (framePos == partitionSize)
+        {
+            std::copy (frame + partitionSize, frame + fftSize, frame);
+            std::fill (frame + partitionSize, frame + fftSize, 0.0f);
+            fdlHead = (fdlHead + 1) % maxPartitions;
+            framePos = 0;
+            fading = false;
+        }
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <JuceHeader.h>
+#include "MemoryLock.h"
+
+// Binaural convolver for short, constantly switching HRIR pairs: one mono source in, two ears out.
+// Uniformly partitioned overlap-save with a frequency-domain delay line; the partition size
+// is the size prepare() gets, which in the plugin is its fixed 128-sample processing quantum
+// whatever the host block size. Both ears share the delay line, so one forward FFT per call
+// feeds both, and spectra are stored split-complex (separate re / im arrays, cache-line
+// aligned) so the complex multiply-add runs on SIMD registers.
+//
+// Zero latency: the current partition is re-transformed on every call with whatever part of
+// it has arrived, the older partitions are summed once per partition. New kernels are swapped
+// in at partition boundaries and crossfaded over one partition.
+class PartitionedConvolver
+{
+public:
+    static constexpr int minPartitionSize = 32;
+    static constexpr int maxPartitionSize = 1024;
+    static constexpr int maxKernelLength = 1024; // longer IRs are truncated (SADIE goes up to 512)
+    static constexpr int numStagedKernels = 4;
+
+    // specialisedLoops = false keeps the generic inner loops at every size, for checking the two against
+    // each other (see Benchmarks/ and Tests/)
+    void prepare (int maxBlockSize, bool specialisedLoops = true);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const { set.add (storage.data(), storage.size() * sizeof (float)); }
+
+    // Forgets the input but keeps the kernels, for picking up again after a gap in the input.
+    // A pending kernel is taken over directly, there's nothing to fade from.
+    void clearHistory();
+
+    // Input that's only remembered, not rendered: one forward FFT per partition and no output, for refilling
+    // the delay line after clearHistory() from input the caller kept. getKernelLength() samples cover the tail.
+    void pushHistory (const float* input, int numSamples);
+
+    // the kernel that's playing or about to, rounded up to whole partitions
+    int getKernelLength() const noexcept { return (kernelPending ? next : current).numPartitions * partitionSize; }
+
+    // Forgets which kernels the ids stand for, but keeps the input and what's playing: after a switch to
+    // another database the next setKernel() is transformed afresh and crossfaded in like any other change.
+    void invalidateKernels() noexcept;
+
+    int getPartitionSize() const noexcept { return partitionSize; }
+
+    // audio thread ------------------------------------------------------
+    // Kernels are identified by an id (the database index), so one staged ahead of time is swapped in
+    // without any work. Otherwise it's transformed here. Either way it's used from the next partition boundary.
+    void setKernel (int id, const float* left, const float* right, int length);
+
+    // Transforms a kernel that's likely to be asked for soon into a spare slot (no-op if it's already there).
+    void prestageKernel (int id, const float* left, const float* right, int length);
+
+    // input may alias outL
+    void process (const float* input, float* outL, float* outR, int numSamples);
+
+    // The inner loops, compiled once per common size so they unroll (see prepare / transformKernel):
+    // partition sizes 32 .. 512, and 1 .. 32 partitions, which covers 256 / 512 / 1024 tap IRs.
+    // Anything else runs the generic versions.
+    using MultiplyAccumulate = void (*) (const float* a, const float* b, float* acc, int binStride);
+    using TailAccumulate = void (*) (const float* fdl, int fdlHead, const float* kernel, float* tail,
+                                     int numPartitions, int binStride, int maxPartitions);
+    static constexpr int numTailVariants = 6;
+
+    // acc += a * b on split-complex arrays (n re, then n im), n a multiple of the register size and everything
+    // aligned. Also what the batch engine multiplies with.
+    static forcedinline void complexMultiplyAccumulate (const float* a, const float* b, float* acc, int n) noexcept
+    {
+        using Vec = juce::dsp::SIMDRegister<float>;
+        const float* aIm = a + n;
+        const float* bIm = b + n;
+        float* accIm = acc + n;
+
+        for (int k = 0; k < n; k += (int) Vec::size())
+        {
+            const auto ar = Vec::fromRawArray (a + k),   ai = Vec::fromRawArray (aIm + k);
+            const auto br = Vec::fromRawArray (b + k),   bi = Vec::fromRawArray (bIm + k);
+
+            (Vec::fromRawArray (acc + k)   + ar * br - ai * bi).copyToRawArray (acc + k);
+            (Vec::fromRawArray (accIm + k) + ar * bi + ai * br).copyToRawArray (accIm + k);
+        }
+    }
+
+    // The frequency-domain side of the convolver, also used by the renderers that convolve in the same
+    // layout (VirtualSpeakerRenderer): real FFTs of two partitions, bins 0..partitionSize kept split-complex,
+    // re then im, binStride floats each so every array starts on a cache line.
+    class Transform
+    {
+    public:
+        // bins 0..partitionSize rounded up to 16 floats, one 64-byte cache line
+        static constexpr int getBinStride (int partitionSize) noexcept { return (partitionSize + 1 + 15) / 16 * 16; }
+
+        // `buffer` is the owner's, 2 * fftSize floats; the owner may use it between calls
+        void prepare (int newPartitionSize, float* buffer);
+
+        // src (length samples, the rest zero) -> spectrum
+        void forward (const float* src, int length, float* dst) const noexcept;
+
+        // spectrum -> numSamples of the valid half (overlap-save), from offset on; dst may be the buffer
+        void inverse (const float* src, float* dst, int offset, int numSamples) const noexcept;
+
+        // An IR pair cut into partitions and transformed at the convolvers' level (HRTFDatabase::getKernelGain):
+        // ear e, partition p goes to spectrum e * maxPartitions + p of dst. Returns the number of partitions.
+        int transformKernel (const float* left, const float* right, int length, int maxPartitions, float* dst) const noexcept;
+
+    private:
+        std::unique_ptr<juce::dsp::FFT> fft;
+        float* fftBuffer = nullptr;
+        int partitionSize = 0, fftSize = 0, binStride = 0;
+    };
+
+private:
+    // spectra of one kernel pair, [ear][partition] -> re then im, binStride floats each
+    struct KernelSet
+    {
+        float* data = nullptr;
+        int numPartitions = 0;
+        int id = -1;
+        TailAccumulate accumulateTails = nullptr; // picked for numPartitions
+    };
+
+    float* spectrum (float* base, int index) const noexcept { return base + (size_t) index * 2 * (size_t) binStride; }
+    float* kernelSpectrum (const KernelSet& set, int ear, int partition) const noexcept { return spectrum (set.data, ear * maxPartitions + partition); }
+    float* delayLineSlot (int index) const noexcept { return spectrum (fdl, (index + maxPartitions) % maxPartitions); }
+
+    void transformKernel (KernelSet& set, int id, const float* left, const float* right, int length);
+    void startPartition();
+    void accumulateTail (const KernelSet& set, float* tail);
+
+    int partitionSize = 0, fftSize = 0, binStride = 0, maxPartitions = 0;
+    Transform transform;
+
+    std::vector<float> storage;
+    float* fdl = nullptr;
+    float* frame = nullptr;    // previous partition, then the current one filling up
+    float* fftBuffer = nullptr;
+    float* tails = nullptr;    // older partitions' contribution: [new L, new R, old L, old R]
+    float* acc = nullptr;
+
+    KernelSet current, previous, next;
+    std::array<KernelSet, numStagedKernels> staged;
+    int nextStagedSlot = 0;
+    bool kernelPending = false, fading = false;
+
+    int fdlHead = 0, framePos = 0;
+
+    MultiplyAccumulate multiplyAccumulate = nullptr;
+    std::array<TailAccumulate, numTailVariants> tailVariants {}; // [log2 (numPartitions)]
+};
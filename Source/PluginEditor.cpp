@@ -2,9 +2,10 @@
 #include "PluginEditor.h"
 
 NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor (NewProjectAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p)
+    : AudioProcessorEditor (&p), sphereView (p), audioProcessor (p)
 {
     setLookAndFeel (&annieStyle);
+    setOpaque (true);
 
     auto setupLabel = [this](juce::Label& l, juce::String text) {
         l.setText (text, juce::dontSendNotification);
@@ -45,18 +46,80 @@ NewProjectAudioProcessorEditor::NewProjectAudioProcessorEditor (NewProjectAudioP
         });
     };
 
+    addAndMakeVisible (diffuseFieldButton);
+    diffuseFieldButton.setClickingTogglesState (true);
+    diffuseFieldAttach = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(audioProcessor.getAPVTS(), "diffuseFieldEQ", diffuseFieldButton);
+
+    // headphone EQ: click to pick a FIR .wav, click again to remove it
+    addAndMakeVisible (headphoneEQButton);
+    headphoneEQButton.setToggleState (audioProcessor.getHeadphoneEQFile().existsAsFile(), juce::dontSendNotification);
+    headphoneEQButton.onClick = [this] {
+        if (audioProcessor.getHeadphoneEQFile().existsAsFile()) {
+            audioProcessor.setHeadphoneEQFile (juce::File());
+            headphoneEQButton.setToggleState (false, juce::dontSendNotification);
+            repaint();
+            return;
+        }
+
+        chooser = std::make_unique<juce::FileChooser> ("Select Headphone EQ FIR", juce::File::getSpecialLocation(juce::File::userDocumentsDirectory), "*.wav");
+        chooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this] (const juce::FileChooser& fc) {
+            auto result = fc.getResult();
+            if (result.existsAsFile()) {
+                audioProcessor.setHeadphoneEQFile (result);
+                repaint();
+            }
+            headphoneEQButton.setToggleState (audioProcessor.getHeadphoneEQFile().existsAsFile(), juce::dontSendNotification);
+        });
+    };
+
     addAndMakeVisible (clearHRTFButton);
     clearHRTFButton.onClick = [this] {
         audioProcessor.clearHRTFDirectory();
         repaint();
     };
+
+    // subject A / B / C / D: the one that's heard, and the one the buttons above load into / clear
+    for (int i = 0; i < NewProjectAudioProcessor::numSubjects; ++i) {
+        auto& b = subjectButtons[(size_t) i];
+        b.setButtonText (juce::String::charToString ((juce::juce_wchar) ('A' + i)));
+        b.onClick = [this, i] { subjectAttach->setValueAsCompleteGesture ((float) i); };
+        addAndMakeVisible (b);
+    }
+
+    subjectAttach = std::make_unique<juce::ParameterAttachment> (*audioProcessor.getAPVTS().getParameter ("subject"), [this] (float value) {
+        for (int i = 0; i < NewProjectAudioProcessor::numSubjects; ++i)
+            subjectButtons[(size_t) i].setToggleState (juce::roundToInt (value) == i, juce::dontSendNotification);
+        repaint();
+    });
+    subjectAttach->sendInitialUpdate();
+    
+    addAndMakeVisible (sphereView);
     
-    setSize (460, 400);
+    setSize (460, 600);
 }
 
 NewProjectAudioProcessorEditor::~NewProjectAudioProcessorEditor() { setLookAndFeel (nullptr); }
 
 void NewProjectAudioProcessorEditor::paint (juce::Graphics& g)
+{
+    const auto key = audioProcessor.getHRTFDirectory().getFullPathName() + "|" + juce::String (audioProcessor.getHRTFCacheSize());
+    
+    if (backgroundCache.isNull() || key != backgroundKey)
+    {
+        backgroundKey = key;
+        
+        const float scale = juce::Component::getApproximateScaleFactorForComponent (this);
+        backgroundCache = juce::Image (juce::Image::RGB, juce::roundToInt (getWidth() * scale), juce::roundToInt (getHeight() * scale), false);
+        
+        juce::Graphics cacheGraphics (backgroundCache);
+        cacheGraphics.addTransform (juce::AffineTransform::scale (scale));
+        drawBackground (cacheGraphics);
+    }
+    
+    g.drawImage (backgroundCache, getLocalBounds().toFloat());
+}
+
+void NewProjectAudioProcessorEditor::drawBackground (juce::Graphics& g)
 {
     g.fillAll (juce::Colour (0xFF14FFDC)); // Neon Cyan
     
@@ -105,7 +168,7 @@ void NewProjectAudioProcessorEditor::paint (juce::Graphics& g)
                 }
         
         
-        auto buttonBounds = loadHRTFButton.getBounds();
+        auto buttonBounds = loadHRTFButton.getBounds().getUnion (clearHRTFButton.getBounds());
         
         auto textBounds = juce::Rectangle<int> (buttonBounds.getX(),
                                                buttonBounds.getBottom() + 5,
@@ -124,17 +187,27 @@ void NewProjectAudioProcessorEditor::paint (juce::Graphics& g)
 
 void NewProjectAudioProcessorEditor::resized()
 {
+    backgroundCache = {};
+    
     auto area = getLocalBounds();
     
     area.removeFromTop (77);
     
-    auto footerArea = area.removeFromBottom(98);
+    auto footerArea = area.removeFromBottom(138);
+    
+    sphereView.setBounds (area.removeFromBottom (160).reduced (20, 0));
     
     footerArea.removeFromTop(17);
     
-    auto buttonRow = footerArea.removeFromTop(45).withSizeKeepingCentre(360, 35);
-    loadHRTFButton.setBounds (buttonRow.removeFromLeft (260).reduced(5, 0));
-    clearHRTFButton.setBounds (buttonRow.removeFromLeft (100).reduced(5, 0));
+    auto subjectRow = footerArea.removeFromTop(40).withSizeKeepingCentre(200, 35);
+    for (auto& b : subjectButtons)
+        b.setBounds (subjectRow.removeFromLeft (50).reduced(5, 0));
+    
+    auto buttonRow = footerArea.removeFromTop(45).withSizeKeepingCentre(420, 35);
+    loadHRTFButton.setBounds (buttonRow.removeFromLeft (200).reduced(5, 0));
+    diffuseFieldButton.setBounds (buttonRow.removeFromLeft (75).reduced(5, 0));
+    headphoneEQButton.setBounds (buttonRow.removeFromLeft (75).reduced(5, 0));
+    clearHRTFButton.setBounds (buttonRow.removeFromLeft (70).reduced(5, 0));
 
     auto knobsArea = area.reduced(20, 10);
     int colWidth = knobsArea.getWidth() / 3;
@@ -1,6 +1,7 @@
 #pragma once
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "SphereView.h"
 
 // Customized UI
 class AnnieLookAndFeel : public juce::LookAndFeel_V4
@@ -46,7 +47,7 @@ public:
         g.setColour (juce::Colours::hotpink);
         g.drawRoundedRectangle (bounds, cornerSize, 3.0f);
         
-        if (shouldDrawButtonAsDown || shouldDrawButtonAsHighlighted) {
+        if (shouldDrawButtonAsDown || shouldDrawButtonAsHighlighted || button.getToggleState()) {
             g.setColour (juce::Colours::hotpink.withAlpha (0.1f));
             g.fillRoundedRectangle (bounds, cornerSize);
         }
@@ -80,10 +81,14 @@ public:
             float shadowOffset = 2.0f;
             float strokeThickness = 6.0f;
 
+            auto& arcs = getCachedArcs (slider, { x, y, width, height }, [&] (ArcCache& cache) {
+                juce::Path bgPath;
+                bgPath.addCentredArc(centreX, centreY, radius, radius, 0.0f, -maxSpreadAngle, maxSpreadAngle, true);
+                juce::PathStrokeType(strokeThickness, juce::PathStrokeType::curved, juce::PathStrokeType::rounded).createStrokedPath (cache.main, bgPath);
+            });
+
             g.setColour (juce::Colours::dodgerblue.withAlpha(0.8f));
-            juce::Path bgPath;
-            bgPath.addCentredArc(centreX, centreY, radius, radius, 0.0f, -maxSpreadAngle, maxSpreadAngle, true);
-            g.strokePath(bgPath, juce::PathStrokeType(strokeThickness, juce::PathStrokeType::curved, juce::PathStrokeType::rounded));
+            g.fillPath (arcs.main);
 
             if (sliderPos > 0.001f)
             {
@@ -120,15 +125,22 @@ public:
             auto radiusOld = (float) juce::jmin (width / 2, height / 2) - 25.0f;
             auto angle = rotaryStartAngle + sliderPos * (rotaryEndAngle - rotaryStartAngle);
 
+            auto& arcs = getCachedArcs (slider, { x, y, width, height }, [&] (ArcCache& cache) {
+                const juce::PathStrokeType stroke (6.0f, juce::PathStrokeType::curved, juce::PathStrokeType::rounded);
+                juce::Path shadow;
+                shadow.addCentredArc (centreX + 2.0f, centreY + 2.0f, radiusOld, radiusOld, 0.0f, rotaryStartAngle, rotaryEndAngle, true);
+                stroke.createStrokedPath (cache.shadow, shadow);
+
+                juce::Path main;
+                main.addCentredArc (centreX, centreY, radiusOld, radiusOld, 0.0f, rotaryStartAngle, rotaryEndAngle, true);
+                stroke.createStrokedPath (cache.main, main);
+            });
+
             g.setColour (juce::Colours::dodgerblue);
-            juce::Path shadow;
-            shadow.addCentredArc (centreX + 2.0f, centreY + 2.0f, radiusOld, radiusOld, 0.0f, rotaryStartAngle, rotaryEndAngle, true);
-            g.strokePath (shadow, juce::PathStrokeType (6.0f, juce::PathStrokeType::curved, juce::PathStrokeType::rounded));
+            g.fillPath (arcs.shadow);
 
             g.setColour (juce::Colours::hotpink);
-            juce::Path main;
-            main.addCentredArc (centreX, centreY, radiusOld, radiusOld, 0.0f, rotaryStartAngle, rotaryEndAngle, true);
-            g.strokePath (main, juce::PathStrokeType (6.0f, juce::PathStrokeType::curved, juce::PathStrokeType::rounded));
+            g.fillPath (arcs.main);
 
             float dotSize = 16.0f;
             auto dotX = centreX + std::sin (angle) * radiusOld;
@@ -159,6 +171,28 @@ public:
 
 private:
     juce::Typeface::Ptr customTypeface;
+
+    // the knob tracks only depend on the knob's size, so they're stroked once and refilled on every move
+    struct ArcCache
+    {
+        juce::Rectangle<int> bounds;
+        juce::Path main, shadow;
+    };
+
+    std::map<const juce::Slider*, ArcCache> arcCache;
+
+    template <typename BuildFn>
+    const ArcCache& getCachedArcs (const juce::Slider& slider, juce::Rectangle<int> bounds, BuildFn&& build)
+    {
+        auto& cache = arcCache[&slider];
+        if (cache.bounds != bounds || cache.main.isEmpty())
+        {
+            cache = {};
+            cache.bounds = bounds;
+            build (cache);
+        }
+        return cache;
+    }
 };
 
 class NewProjectAudioProcessorEditor  : public juce::AudioProcessorEditor
@@ -170,15 +204,28 @@ public:
     void resized() override;
 
 private:
+    void drawBackground (juce::Graphics&);
+    
     AnnieLookAndFeel annieStyle;
     
+    //title + status only change with the folder, so they're kept in an image
+    juce::Image backgroundCache;
+    juce::String backgroundKey;
+    
     juce::Slider aziSlider, eleSlider, widthSlider;
     juce::Label aziLabel, eleLabel, widthLabel;
     juce::TextButton loadHRTFButton { "LOAD HRIR WAV" };
     juce::TextButton clearHRTFButton { "Clear" };
+    juce::TextButton diffuseFieldButton { "DF EQ" };
+    juce::TextButton headphoneEQButton { "HP EQ" };
+    std::array<juce::TextButton, NewProjectAudioProcessor::numSubjects> subjectButtons;
     std::unique_ptr<juce::FileChooser> chooser;
     
+    SphereView sphereView;
+    
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> aziAttach, eleAttach, widthAttach;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> diffuseFieldAttach;
+    std::unique_ptr<juce::ParameterAttachment> subjectAttach;
     
     NewProjectAudioProcessor& audioProcessor;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NewProjectAudioProcessorEditor)
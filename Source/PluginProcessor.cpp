@@ -7,11 +7,6 @@ namespace {
         while (a >= 360.0f) a -= 360.0f;
         return a;
     }
-    
-    static inline float circularDistanceDeg (float a, float b) {
-        float d = std::abs (a - b);
-        return std::min (d, 360.0f - d);
-    }
 }
 
 NewProjectAudioProcessor::NewProjectAudioProcessor()
@@ -19,9 +14,29 @@ NewProjectAudioProcessor::NewProjectAudioProcessor()
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)),
       apvts (*this, nullptr, "PARAMETERS", createParameterLayout())
-{}
+{
+    headTracker.attachToModeParameter (apvts.getRawParameterValue ("headTracking"));
+    apvts.addParameterListener ("diffuseFieldEQ", this);
+    apvts.addParameterListener ("sharedEngine", this);
+    apvts.addParameterListener ("basisComponents", this);
+    apvts.addParameterListener ("compactHRIRs", this);
+    apvts.addParameterListener ("quality", this);
+    apvts.addParameterListener ("lockMemory", this);
+}
 
-NewProjectAudioProcessor::~NewProjectAudioProcessor() {}
+NewProjectAudioProcessor::~NewProjectAudioProcessor()
+{
+    apvts.removeParameterListener ("diffuseFieldEQ", this);
+    apvts.removeParameterListener ("sharedEngine", this);
+    apvts.removeParameterListener ("basisComponents", this);
+    apvts.removeParameterListener ("compactHRIRs", this);
+    apvts.removeParameterListener ("quality", this);
+    apvts.removeParameterListener ("lockMemory", this);
+    cancelPendingUpdate();
+    
+    //a restore may still be loading, and it holds this
+    loaderPool.removeAllJobs (true, 30000);
+}
 
 juce::AudioProcessorValueTreeState::ParameterLayout NewProjectAudioProcessor::createParameterLayout()
 {
@@ -30,211 +45,909 @@ juce::AudioProcessorValueTreeState::ParameterLayout NewProjectAudioProcessor::cr
     layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID {"azimuth", 1},   "Azimuth",      0.0f, 360.0f, 0.0f));
     layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID {"elevation", 1}, "Elevation",   -90.0f, 90.0f, 0.0f));
     layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID {"width", 1},     "Width",        0.0f, 100.0f, 0.0f));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID {"distance", 1},  "Distance",
+                                                             juce::NormalisableRange<float> (DistanceEngine::minDistance, DistanceEngine::maxDistance, 0.01f, 0.3f),
+                                                             DistanceEngine::referenceDistance,
+                                                             juce::AudioParameterFloatAttributes().withLabel ("m")));
+    layout.add (std::make_unique<juce::AudioParameterBool>  (juce::ParameterID {"propagationDelay", 1}, "Propagation Delay", false));
+    layout.add (std::make_unique<juce::AudioParameterBool>  (juce::ParameterID {"diffuseFieldEQ", 1}, "Diffuse-Field EQ", false,
+                                                             juce::AudioParameterBoolAttributes().withAutomatable (false)));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (juce::ParameterID {"headTracking", 1}, "Head Tracking",
+                                                              juce::StringArray { "Off", "OSC (UDP " + juce::String (HeadTracker::defaultPort) + ")", "MIDI CC", "Loopback" }, 0));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID {"room", 1},      "Room",         0.0f, 100.0f, 0.0f));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID {"roomSize", 1},  "Room Size",
+                                                             juce::NormalisableRange<float> (RoomEngine::minRoomSize, RoomEngine::maxRoomSize, 0.1f, 0.5f),
+                                                             8.0f,
+                                                             juce::AudioParameterFloatAttributes().withLabel ("m")));
+    layout.add (std::make_unique<juce::AudioParameterBool>  (juce::ParameterID {"sharedEngine", 1}, "Shared Engine", false,
+                                                             juce::AudioParameterBoolAttributes().withAutomatable (false)));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (juce::ParameterID {"basisComponents", 1}, "Basis Rendering",
+                                                              juce::StringArray { "Off", "8 Components", "16 Components", "32 Components", "64 Components" }, 0,
+                                                              juce::AudioParameterChoiceAttributes().withAutomatable (false)));
+    layout.add (std::make_unique<juce::AudioParameterBool>  (juce::ParameterID {"compactHRIRs", 1}, "16-bit HRIRs", false,
+                                                             juce::AudioParameterBoolAttributes().withAutomatable (false)));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (juce::ParameterID {"quality", 1}, "Quality",
+                                                              juce::StringArray { "Full", "Adaptive" }, 0,
+                                                              juce::AudioParameterChoiceAttributes().withAutomatable (false)));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (juce::ParameterID {"lockMemory", 1}, "Lock Memory",
+                                                              juce::StringArray { "Off", "Up to 64 MB", "Up to 256 MB", "Up to 1 GB" }, 0,
+                                                              juce::AudioParameterChoiceAttributes().withAutomatable (false)));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (juce::ParameterID {"subject", 1}, "Subject",
+                                                              juce::StringArray { "A", "B", "C", "D" }, 0));
     
     return layout;
 }
 
+bool NewProjectAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
+{
+    const auto& input = layouts.getMainInputChannelSet();
+    const auto& output = layouts.getMainOutputChannelSet();
+    const bool monoOrStereoIn = input == juce::AudioChannelSet::mono() || input == juce::AudioChannelSet::stereo();
+    
+    //two sources panned over a speaker array
+    if (VBAPPanner::isSupportedLayout (output))
+        return monoOrStereoIn;
+    
+    //headphones out; two sources from mono / stereo, or a virtual speaker per channel of a surround bed
+    if (output != juce::AudioChannelSet::stereo())
+        return false;
+    
+    return monoOrStereoIn || VirtualSpeakerRenderer::isSupportedLayout (input);
+}
+
 void NewProjectAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
     
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (juce::uint32) samplesPerBlock;
-    spec.numChannels = 2;
-
-    convL.prepare (spec);
-    convR.prepare (spec);
+    //everything below the FIFO runs in fixed quanta, whatever the host sends
+    juce::ignoreUnused (samplesPerBlock);
+    const int numFifoChannels = juce::jmax (2, getTotalNumInputChannels(), getTotalNumOutputChannels());
+    fifoIn.setSize (numFifoChannels, internalBlockSize);
+    fifoOut.setSize (numFifoChannels, internalBlockSize);
+    fifoIn.clear();
+    fifoOut.clear();
+    fifoPos = 0;
+    
+    convL.prepare (internalBlockSize);
+    convR.prepare (internalBlockSize);
+    basisRenderer.prepare (internalBlockSize);
+    lodL.prepare (sampleRate, internalBlockSize);
+    lodR.prepare (sampleRate, internalBlockSize);
 
-    spatialLBuffer.setSize (2, samplesPerBlock);
-    spatialRBuffer.setSize (2, samplesPerBlock);
+    spatialLBuffer.setSize (2, internalBlockSize);
+    spatialRBuffer.setSize (2, internalBlockSize);
     
     smoothedAzi.reset (sampleRate, 0.1);
     smoothedEle.reset (sampleRate, 0.1);
     smoothedWidth.reset (sampleRate, 0.1);
+    smoothedDistance.reset (sampleRate, 0.1);
+    smoothedRoom.reset (sampleRate, 0.1);
     
     smoothedAzi.setCurrentAndTargetValue (apvts.getRawParameterValue ("azimuth")->load());
     smoothedEle.setCurrentAndTargetValue (apvts.getRawParameterValue ("elevation")->load());
     smoothedWidth.setCurrentAndTargetValue (apvts.getRawParameterValue ("width")->load());
+    smoothedDistance.setCurrentAndTargetValue (apvts.getRawParameterValue ("distance")->load());
+    
+    smoothedRoom.setCurrentAndTargetValue (apvts.getRawParameterValue ("room")->load() / 100.0f);
+    
+    distanceL.prepare (sampleRate);
+    distanceR.prepare (sampleRate);
+    
+    room.prepare (sampleRate, internalBlockSize);
+    roomInputBuffer.setSize (1, internalBlockSize);
+    
+    //surround / immersive input: virtual speakers instead of the two sources
+    const auto inputLayout = getChannelLayoutOfBus (true, 0);
+    usingSpeakerLayout = VirtualSpeakerRenderer::isSupportedLayout (inputLayout);
+    if (usingSpeakerLayout)
+        speakerRenderer.prepare (inputLayout, internalBlockSize);
+    
+    //a speaker array out instead of headphones: VBAP, the HRIRs aren't used
+    const auto outputLayout = getChannelLayoutOfBus (false, 0);
+    usingSpeakerOutput = VBAPPanner::isSupportedLayout (outputLayout);
+    if (usingSpeakerOutput)
+        vbap.prepare (outputLayout, internalBlockSize);
+    
+    //the engine voices are reset with the new database in the first processBlock
+    const bool shared = apvts.getRawParameterValue ("sharedEngine")->load() > 0.5f;
+    engineVoiceL.setEnabled (shared);
+    engineVoiceR.setEnabled (shared);
     
     loadHRTFDatabaseToMemory (sampleRate);
+    updateMemoryLock();
     
     //report latency to daw to fix phase issue
-    //setLatencySamples(convL.getLatency());
-    
-    int currentLatency = convL.getLatency();
-        setLatencySamples (currentLatency);
+    updateLatency();
+}
+
+void NewProjectAudioProcessor::updateLatency()
+{
+    const bool shared = apvts.getRawParameterValue ("sharedEngine")->load() > 0.5f;
+    int currentLatency = internalBlockSize + (shared ? BatchRenderEngine::latencySamples : 0);
+    setLatencySamples (currentLatency);
     
     //check latency
     DBG("LATENCY CHECK: " << currentLatency);
 }
 
+void NewProjectAudioProcessor::reportPoseRendered (int quantumEnd, int offset) noexcept
+{
+    //the quantum finished at quantumEnd of this host block and comes out of the FIFO from there on, the sub-block
+    //`offset` samples later (plus the shared engine's delay); the host plays the block about one block after this
+    //callback. That's the real path a pose takes to the output, minus the tracker's and the converters' delay
+    const bool shared = apvts.getRawParameterValue ("sharedEngine")->load() > 0.5f;
+    const int samplesUntilOutput = quantumEnd + offset + (shared ? BatchRenderEngine::latencySamples : 0) + getBlockSize();
+    headTracker.reportRendered (headPose, samplesUntilOutput / currentSampleRate);
+}
+
+int NewProjectAudioProcessor::getSelectedSubject() const
+{
+    //A, B, C, D
+    return juce::jlimit (0, numSubjects - 1, juce::roundToInt (apvts.getRawParameterValue ("subject")->load()));
+}
+
 void NewProjectAudioProcessor::setHRTFDirectory (const juce::File& newDir)
 {
-    hrtfRoot = newDir;
-    loadHRTFDatabaseToMemory (getSampleRate());
+    //into the selected subject, the others stay as they are
+    const int subject = getSelectedSubject();
+    subjects[(size_t) subject].root = newDir;
+    loadHRTFDatabaseToMemory (getSampleRate(), subject);
+}
+
+void NewProjectAudioProcessor::updateLoadedSettings()
+{
+    loadedWithDiffuseField = getEqualisation().diffuseField;
+    loadedBasisComponents = getBasisComponents();
+    loadedSampleFormat = getSampleFormat();
+    loadedLevelsOfDetail = isAdaptiveQuality();
+}
+
+bool NewProjectAudioProcessor::loadedSettingsChanged() const
+{
+    return getEqualisation().diffuseField != loadedWithDiffuseField
+           || getBasisComponents() != loadedBasisComponents
+           || getSampleFormat() != loadedSampleFormat
+           || isAdaptiveQuality() != loadedLevelsOfDetail;
+}
+
+HRTFDatabase::Equalisation NewProjectAudioProcessor::getLoadedEqualisation() const
+{
+    HRTFDatabase::Equalisation eq;
+    eq.diffuseField = loadedWithDiffuseField;
+    eq.headphoneFilter = headphoneEQFile;
+    return eq;
 }
 
 void NewProjectAudioProcessor::loadHRTFDatabaseToMemory (double sampleRate)
 {
-    //clear previous hrtf data
-    hrtfCache.clear();
+    updateLoadedSettings();
     
-    if (!hrtfRoot.isDirectory())
-        return;
+    //one decode per folder at most, subjects and instances on the same one share it
+    for (int subject = 0; subject < numSubjects; ++subject)
+        loadHRTFDatabaseToMemory (sampleRate, subject);
+    
+    if (currentSampleRate > 0)
+        updateLatency();
+}
 
-    juce::AudioFormatManager formatManager;
-    formatManager.registerBasicFormats();
+void NewProjectAudioProcessor::loadHRTFDatabaseToMemory (double sampleRate, int subject)
+{
+    auto& s = subjects[(size_t) subject];
+    
+    //overrides any restore still loading in the background
+    const auto request = ++s.loadRequest;
     
-    // select foder based on sample rate
-    juce::String folderName = (sampleRate <= 44100.0) ? "44K_16bit" : (sampleRate <= 48000.0 ? "48K_24bit" : "96K_24bit");
-    juce::File targetDir = hrtfRoot.getChildFile (folderName);
+    //the old database stays valid for processBlock until the new one is swapped in
+    publishIfLatest (subject, request, HRTFDatabase::loadShared (s.root, sampleRate, getLoadedEqualisation(),
+                                                                 loadedBasisComponents, loadedSampleFormat, loadedLevelsOfDetail));
+}
 
-    if (!targetDir.exists())
+void NewProjectAudioProcessor::loadHRTFDatabaseAsync (double sampleRate, int subject, juce::uint64 savedHash, double savedHashRate)
+{
+    auto& s = subjects[(size_t) subject];
+    
+    const auto request = ++s.loadRequest;
+    s.contentHash = savedHash;
+    s.contentHashRate = savedHashRate;
+    
+    loaderPool.addJob ([this, subject, request, root = s.root, sampleRate, equalisation = getLoadedEqualisation(),
+                        basisComponents = loadedBasisComponents, format = loadedSampleFormat, levelsOfDetail = loadedLevelsOfDetail,
+                        savedHash, savedHashRate]
     {
-        DBG("Target HRTF subdirectory not found: " + targetDir.getFullPathName());
-        return;
-    }
+        //superseded while queued, don't bother decoding
+        if (subjects[(size_t) subject].loadRequest.load() != request)
+            return juce::ThreadPoolJob::jobHasFinished;
+        
+        auto db = HRTFDatabase::loadShared (root, sampleRate, equalisation, basisComponents, format, levelsOfDetail);
+        
+        if (db != nullptr && savedHash != 0 && savedHashRate == db->getSampleRate() && savedHash != db->getContentHash())
+            DBG("HRTF set in " + root.getFullPathName() + " has changed since the state was saved.");
+        
+        if (publishIfLatest (subject, request, std::move (db)))
+            triggerAsyncUpdate();
+        
+        return juce::ThreadPoolJob::jobHasFinished;
+    });
+}
 
-    auto files = targetDir.findChildFiles (juce::File::findFiles, false, "*.wav");
+bool NewProjectAudioProcessor::publishIfLatest (int subject, uint32_t request, std::shared_ptr<const HRTFDatabase> db)
+{
+    RealtimeSafetyChecker::assertNotAudioThread ("publishIfLatest (loadLock)");
     
-    if (files.isEmpty()) {
-            DBG("Error: No .wav files found in: " + targetDir.getFullPathName());
-            return;
-        }
+    const juce::ScopedLock sl (loadLock);
+    auto& s = subjects[(size_t) subject];
+    
+    if (s.loadRequest.load() != request)
+        return false;
+    
+    s.contentHash = db != nullptr ? db->getContentHash() : 0;
+    s.contentHashRate = db != nullptr ? db->getSampleRate() : 0.0;
+    
+    //the basis path adds the onset delay (up to one IR) in front of the filters
+    s.filterSeconds = db != nullptr ? db->getIRLength() * (db->hasBasis() ? 2 : 1) / db->getSampleRate() : 0.0;
+    
+    //unlock the old set while the publisher still holds it, lock the new one as soon as it's live
+    const auto* newDatabase = db.get();
+    s.locked.clear();
+    s.publisher.publish (std::move (db));
+    
+    if (lockedCeiling > 0 && newDatabase != nullptr)
+        newDatabase->lockInMemory (s.locked);
+    
+    return true;
+}
+
+HRTFDatabase::Equalisation NewProjectAudioProcessor::getEqualisation() const
+{
+    HRTFDatabase::Equalisation eq;
+    eq.diffuseField = apvts.getRawParameterValue ("diffuseFieldEQ")->load() > 0.5f;
+    eq.headphoneFilter = headphoneEQFile;
+    return eq;
+}
+
+int NewProjectAudioProcessor::getBasisComponents() const
+{
+    //Off, 8, 16, 32, 64
+    const int choice = juce::roundToInt (apvts.getRawParameterValue ("basisComponents")->load());
+    return choice > 0 ? 4 << choice : 0;
+}
+
+HRTFDatabase::SampleFormat NewProjectAudioProcessor::getSampleFormat() const
+{
+    return apvts.getRawParameterValue ("compactHRIRs")->load() > 0.5f ? HRTFDatabase::SampleFormat::int16
+                                                                         : HRTFDatabase::SampleFormat::float32;
+}
+
+size_t NewProjectAudioProcessor::getMemoryLockCeiling() const
+{
+    //Off, 64 MB, 256 MB, 1 GB
+    const int choice = juce::roundToInt (apvts.getRawParameterValue ("lockMemory")->load());
+    return choice > 0 ? (size_t) 16 << (20 + 2 * choice) : 0;
+}
+
+void NewProjectAudioProcessor::updateMemoryLock()
+{
+    const juce::ScopedLock sl (loadLock);
+    
+    lockedCeiling = getMemoryLockCeiling();
+    lockedBuffers.clear();
+    for (auto& s : subjects)
+        s.locked.clear();
     
-    // Iterate through all files and load them into memory.
-    for (auto& file : files)
+    if (lockedCeiling == 0)
+        return;
+    
+    MemoryLock::setCeiling (lockedCeiling);
+    
+    //the sets first, a rarely used direction (or a subject that hasn't been heard for a while) is what would fault
+    size_t databaseBytes = 0, databaseLockedBytes = 0;
+    for (auto& s : subjects)
     {
-        std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+        if (auto db = s.publisher.getLatest())
+            db->lockInMemory (s.locked);
         
-        if (reader != nullptr)
-        {
-            HRTFRecord record;
-            auto name = file.getFileNameWithoutExtension();
-            
-
-            record.azimuth = wrap360(name.fromFirstOccurrenceOf ("azi_", false, false).upToFirstOccurrenceOf ("_ele", false, false).getFloatValue());
-            record.elevation = juce::jlimit(-90.0f, 90.0f, name.fromFirstOccurrenceOf ("ele_", false, false).getFloatValue());
-            
-            // record.irData
-            record.sampleRate = reader->sampleRate;
-            record.irData.setSize ((int) reader->numChannels, (int) reader->lengthInSamples);
-            reader->read (&record.irData, 0, (int) reader->lengthInSamples, 0, true, true);
-            
-            hrtfCache.push_back (std::move (record));
-        }
+        databaseBytes += s.locked.getRequestedBytes();
+        databaseLockedBytes += s.locked.getLockedBytes();
     }
     
-    DBG("Successfully cached " + juce::String(hrtfCache.size()) + " HRTF files into RAM.");
+    //then everything prepareToPlay sized for the audio thread (this object itself is the host's to place, not ours to lock)
+    auto addBuffer = [this] (const juce::AudioBuffer<float>& b)
+    {
+        if (b.getNumChannels() > 0)
+            lockedBuffers.add (b.getReadPointer (0), (size_t) (b.getNumChannels() * b.getNumSamples()) * sizeof (float));
+    };
+    
+    for (auto* b : { &fifoIn, &fifoOut, &spatialLBuffer, &spatialRBuffer, &roomInputBuffer })
+        addBuffer (*b);
     
-    if (currentSampleRate > 0)
-        setLatencySamples(convL.getLatency());
+    convL.lockInMemory (lockedBuffers);
+    convR.lockInMemory (lockedBuffers);
+    basisRenderer.lockInMemory (lockedBuffers);
+    lodL.lockInMemory (lockedBuffers);
+    lodR.lockInMemory (lockedBuffers);
+    distanceL.lockInMemory (lockedBuffers);
+    distanceR.lockInMemory (lockedBuffers);
+    room.lockInMemory (lockedBuffers);
+    speakerRenderer.lockInMemory (lockedBuffers);
+    vbap.lockInMemory (lockedBuffers);
+    
+    //logged in release builds too, a ceiling the OS refuses is worth knowing about
+    juce::Logger::writeToLog ("Memory locked: " + juce::String ((juce::int64) (databaseLockedBytes + lockedBuffers.getLockedBytes())) + " of "
+        + juce::String ((juce::int64) (databaseBytes + lockedBuffers.getRequestedBytes())) + " bytes ("
+        + juce::String ((juce::int64) MemoryLock::getLockedBytes()) + " process-wide, ceiling " + juce::String ((juce::int64) lockedCeiling) + ")");
 }
 
-const NewProjectAudioProcessor::HRTFRecord* NewProjectAudioProcessor::findBestMatch (float azi, float ele) const
+bool NewProjectAudioProcessor::isAdaptiveQuality() const
 {
-    if (hrtfCache.empty()) return nullptr;
+    //Full, Adaptive
+    return apvts.getRawParameterValue ("quality")->load() > 0.5f;
+}
 
-    const HRTFRecord* best = nullptr;
-    float minD = std::numeric_limits<float>::max();
+void NewProjectAudioProcessor::setHeadphoneEQFile (const juce::File& newFile)
+{
+    headphoneEQFile = newFile;
+    loadHRTFDatabaseToMemory (getSampleRate());
+}
+
+void NewProjectAudioProcessor::parameterChanged (const juce::String&, float)
+{
+    //can arrive on the audio thread, so do the reload from the message thread
+    triggerAsyncUpdate();
+}
 
-    for (auto& item : hrtfCache)
+void NewProjectAudioProcessor::handleAsyncUpdate()
+{
+    const bool shared = apvts.getRawParameterValue ("sharedEngine")->load() > 0.5f;
+    engineVoiceL.setEnabled (shared);
+    engineVoiceR.setEnabled (shared);
+    updateLatency();
+    
+    //the bake (and the basis) take a moment, and restoring a preset can flip the switch too
+    if (loadedSettingsChanged() && getSampleRate() > 0.0)
     {
-        float dA = circularDistanceDeg (item.azimuth, azi);
-        float dE = std::abs (item.elevation - ele);
-        float d = dA + dE;
-        if (d < minD) { minD = d; best = &item; }
+        updateLoadedSettings();
+        for (int subject = 0; subject < numSubjects; ++subject)
+            loadHRTFDatabaseAsync (getSampleRate(), subject, subjects[(size_t) subject].contentHash, subjects[(size_t) subject].contentHashRate);
     }
-    return best;
+    
+    if (getMemoryLockCeiling() != lockedCeiling && getSampleRate() > 0.0)
+        updateMemoryLock();
 }
 
-void NewProjectAudioProcessor::updateKernels (float aziL, float eleL, float aziR, float eleR)
+void NewProjectAudioProcessor::updateKernels (const HRTFDatabase& db, float aziL, float eleL, float aziR, float eleR)
 {
     
-    auto loadFromMemory = [this](juce::dsp::Convolution& conv, float azi, float ele, float& lastAzi, float& lastEle)
+    auto loadFromMemory = [this, &db](PartitionedConvolver& conv, BatchRenderEngine::Voice& voice, LODVoice& lod,
+                                      float azi, float ele, float& lastAzi, float& lastEle, int& kernelIndex)
     {
       
         if (std::abs(azi - lastAzi) > 0.1f || std::abs(ele - lastEle) > 0.1f)
         {
-            if (auto* match = findBestMatch(azi, ele))
+            const int match = db.findNearest (azi, ele);
+            if (match >= 0 && match != kernelIndex)
             {
-                juce::AudioBuffer<float> irCopy;
-                irCopy.makeCopyOf(match->irData);
+                //straight from the database (widened first if it's stored 16-bit); the basis path only needs the index
+                if (usingSharedEngine || !usingBasis)
+                {
+                    const auto ir = db.fetchIR (match, kernelScratch.data());
+                    
+                    if (usingSharedEngine)
+                        voice.setKernel (ir.left, ir.right, db.getIRLength());
+                    else
+                        conv.setKernel (match, ir.left, ir.right, db.getIRLength());
+                }
                 
-                conv.loadImpulseResponse (std::move(irCopy),
-                                          match->sampleRate,
-                                          juce::dsp::Convolution::Stereo::yes,
-                                          juce::dsp::Convolution::Trim::yes,
-                                          juce::dsp::Convolution::Normalise::yes);
+                //the lower tiers' version of it, they can take over at any quantum
+                if (!usingSharedEngine && !usingBasis)
+                    lod.setKernel (db, match);
                 
-                lastAzi = azi;
-                lastEle = ele;
+                kernelIndex = match;
             }
+            
+            lastAzi = azi;
+            lastEle = ele;
         }
     };
 
-    loadFromMemory (convL, aziL, eleL, lastAziL, lastEleL);
-    loadFromMemory (convR, aziR, eleR, lastAziR, lastEleR);
+    loadFromMemory (convL, engineVoiceL, lodL, aziL, eleL, lastAziL, lastEleL, kernelIndexL);
+    
+    //parked at width 0, picks its kernel up again when it's woken
+    if (!rightSourceIdle)
+        loadFromMemory (convR, engineVoiceR, lodR, aziR, eleR, lastAziR, lastEleR, kernelIndexR);
 }
 
-void NewProjectAudioProcessor::clearHRTFDirectory()
+void NewProjectAudioProcessor::prestageKernels (const HRTFDatabase& db, float azi, float ele, float width)
+{
+    //nothing is moving (the head pose is held as it is), the kernels playing now are the ones needed next.
+    //the basis path has no kernels to stage, a move is just new weights
+    if (usingBasis || (!smoothedAzi.isSmoothing() && !smoothedEle.isSmoothing() && !smoothedWidth.isSmoothing()))
+        return;
+    
+    //the smoothers already sit at the start of the next sub-block, keep going the same way for a few more
+    //(never past the target) and stage the first kernel that differs from the one playing
+    auto ahead = [](const juce::LinearSmoothedValue<float>& smoother, float now, int steps)
+    {
+        const float next = smoother.getCurrentValue();
+        const float target = smoother.getTargetValue();
+        return juce::jlimit (juce::jmin (next, target), juce::jmax (next, target), now + (next - now) * (float) steps);
+    };
+    
+    auto stage = [this, &db](PartitionedConvolver& conv, float sourceAzi, float sourceEle, int kernelIndex)
+    {
+        headRotation.apply (sourceAzi, sourceEle);
+        
+        const int index = db.findNearest (sourceAzi, sourceEle);
+        if (index < 0 || index == kernelIndex)
+            return false;
+        
+        db.prefetch (index);
+        if (!usingSharedEngine)
+        {
+            const auto ir = db.fetchIR (index, kernelScratch.data());
+            conv.prestageKernel (index, ir.left, ir.right, db.getIRLength());
+        }
+        return true;
+    };
+    
+    bool stagedL = false, stagedR = rightSourceIdle;
+    
+    for (int step = 1; step <= lookaheadSteps && !(stagedL && stagedR); ++step)
+    {
+        const float a = ahead (smoothedAzi, azi, step);
+        const float e = ahead (smoothedEle, ele, step);
+        const float widthOffset = (ahead (smoothedWidth, width, step) / 100.0f) * 90.0f;
+        
+        if (!stagedL)
+            stagedL = stage (convL, wrap360 (a + widthOffset), e, kernelIndexL);
+        if (!stagedR)
+            stagedR = stage (convR, wrap360 (a - widthOffset), e, kernelIndexR);
+    }
+}
+
+void NewProjectAudioProcessor::storeRenderedPositions (float aziL, float eleL, float aziR, float eleR) noexcept
 {
-    hrtfRoot = juce::File();
-    hrtfCache.clear();
+    auto packAzi = [](float a) { return (juce::uint64) juce::roundToInt (wrap360 (a) / 360.0f * 65535.0f); };
+    auto packEle = [](float e) { return (juce::uint64) juce::roundToInt ((juce::jlimit (-90.0f, 90.0f, e) + 90.0f) / 180.0f * 65535.0f); };
     
-    convL.reset();
-    convR.reset();
+    renderedPositions.store (packAzi (aziL) | (packEle (eleL) << 16) | (packAzi (aziR) << 32) | (packEle (eleR) << 48),
+                             std::memory_order_relaxed);
+}
+
+NewProjectAudioProcessor::RenderedPositions NewProjectAudioProcessor::getRenderedPositions() const noexcept
+{
+    const auto packed = renderedPositions.load (std::memory_order_relaxed);
+    auto unpackAzi = [](juce::uint64 v) { return (float) (v & 0xffff) / 65535.0f * 360.0f; };
+    auto unpackEle = [](juce::uint64 v) { return (float) (v & 0xffff) / 65535.0f * 180.0f - 90.0f; };
     
-    lastAziL = -1000.0f; lastEleL = -1000.0f;
-    lastAziR = -1000.0f; lastEleR = -1000.0f;
+    return { unpackAzi (packed), unpackEle (packed >> 16), unpackAzi (packed >> 32), unpackEle (packed >> 48) };
+}
+
+void NewProjectAudioProcessor::clearHRTFDirectory()
+{
+    //the selected subject only
+    auto& s = subjects[(size_t) getSelectedSubject()];
+    s.root = juce::File();
+    publishIfLatest (getSelectedSubject(), ++s.loadRequest, nullptr);
     
     DBG("HRTF Path and Cache Cleared.");
 }
 
-void NewProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+void NewProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
     const int numSamples = buffer.getNumSamples();
     const int numChannels = buffer.getNumChannels();
+    
+    //blocking calls from here on are reported in debug builds (every allocation and lock under the test runner), and the slowest callback is kept
+    const RealtimeSafetyChecker::CallbackScope callbackScope (realtimeSafety, numSamples / currentSampleRate);
+    
+    if (numChannels == 0)
+        return;
+    
+    //with memory locking on, any page that still had to come from disk during this callback is counted
+    const bool countFaults = lockedCeiling > 0;
+    const auto faultsBefore = countFaults ? MemoryLock::getMajorFaults() : 0;
+    
+    const int numInputs = juce::jmin (getTotalNumInputChannels(), numChannels);
+    const int numOutputs = juce::jmin (getTotalNumOutputChannels(), numChannels, fifoOut.getNumChannels());
+    int midiPos = 0;
+    
+    //host blocks of any size go through the FIFO, the chain only ever sees full quanta
+    for (int written = 0; written < numSamples;)
+    {
+        const int chunk = juce::jmin (numSamples - written, internalBlockSize - fifoPos);
+        
+        //input before output, they are the same memory; a mono input feeds both sources
+        for (int ch = 0; ch < fifoIn.getNumChannels(); ++ch)
+            fifoIn.copyFrom (ch, fifoPos, buffer.getReadPointer (juce::jmin (ch, juce::jmax (0, numInputs - 1)), written), chunk);
+        
+        for (int ch = 0; ch < numOutputs; ++ch)
+            buffer.copyFrom (ch, written, fifoOut, ch, fifoPos, chunk);
+        
+        fifoPos += chunk;
+        written += chunk;
+        
+        if (fifoPos == internalBlockSize)
+        {
+            for (int ch = 0; ch < fifoIn.getNumChannels(); ++ch)
+                fifoOut.copyFrom (ch, 0, fifoIn, ch, 0, internalBlockSize);
+            
+            //timed against the real time it covers, the adaptive quality backs off on it
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            processQuantum (fifoOut, midiMessages, midiPos, written);
+            lodClient.reportLoad (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks),
+                                  internalBlockSize / currentSampleRate);
+            
+            midiPos = written;
+            fifoPos = 0;
+        }
+    }
+    
+    //head poses that came after the last full quantum are picked up by the next one
+    if (midiPos < numSamples && headTracker.getActiveMode() == HeadTracker::Mode::midi
+         && headTracker.handleMidi (midiMessages, midiPos, numSamples, headPose))
+        headRotation.setPose (headPose);
+    
+    if (countFaults && faultsBefore >= 0)
+        audioThreadMajorFaults += MemoryLock::getMajorFaults() - faultsBefore;
+}
+
+void NewProjectAudioProcessor::processQuantum (juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages, int midiStart, int midiEnd)
+{
+    const int numSamples = buffer.getNumSamples();
 
 
     smoothedAzi.setTargetValue (apvts.getRawParameterValue ("azimuth")->load());
     smoothedEle.setTargetValue (apvts.getRawParameterValue ("elevation")->load());
     smoothedWidth.setTargetValue (apvts.getRawParameterValue ("width")->load());
+    smoothedDistance.setTargetValue (apvts.getRawParameterValue ("distance")->load());
+    smoothedRoom.setTargetValue (apvts.getRawParameterValue ("room")->load() / 100.0f);
 
 
     
-    if (hrtfCache.size() > 0) //if there is a folder selected and HRIR is loaded - 3d pan mode
+    //pin the selected subject's database for this block, a reload or a switch can only swap it between blocks
+    const int subject = getSelectedSubject();
+    const HRTFDatabasePublisher::ReadScope database (subjects[(size_t) subject].publisher);
+    const HRTFDatabase* db = database.get();
+    
+    const bool shared = apvts.getRawParameterValue ("sharedEngine")->load() > 0.5f;
+    
+    if (subject != lastSubject || database.getVersion() != lastDatabaseVersion || shared != usingSharedEngine)
+    {
+        //another set on the same engines (an A/B switch, or the subject reloaded): they keep their input and
+        //crossfade into the new set's kernels like on any move, so a switch costs one kernel change.
+        //the basis renderers start from silence on a new set, and a set coming or going switches modes.
+        //the shared engine wins if both are on, it's what the reported latency assumes
+        const bool basis = db != nullptr && db->hasBasis() && !shared;
+        const bool crossfade = db != nullptr && hadDatabase && shared == usingSharedEngine && !usingBasis && !basis;
+        
+        lastSubject = subject;
+        lastDatabaseVersion = database.getVersion();
+        hadDatabase = db != nullptr;
+        usingSharedEngine = shared;
+        
+        lastAziL = -1000.0f; lastEleL = -1000.0f;
+        lastAziR = -1000.0f; lastEleR = -1000.0f;
+        kernelIndexL = kernelIndexR = -1;
+        
+        if (crossfade)
+        {
+            //the shared engine's voices crossfade any new kernel by themselves
+            convL.invalidateKernels();
+            convR.invalidateKernels();
+            lodL.invalidateKernel();
+            lodR.invalidateKernel();
+            speakerRenderer.invalidateKernels();
+            room.crossfadeToNewDatabase();
+        }
+        else
+        {
+            coalescedSamples = 0;
+            rightSourceIdle = false;
+            
+            convL.reset();
+            convR.reset();
+            engineVoiceL.reset();
+            engineVoiceR.reset();
+            lodL.reset();
+            lodR.reset();
+            speakerRenderer.reset();
+            room.invalidateKernels();
+        }
+        
+        //the basis spectra come with the database, taking them on transforms nothing
+        usingBasis = basis;
+        if (db != nullptr)
+        {
+            basisRenderer.setBasis (*db);
+            speakerRenderer.setBasis (*db);
+        }
+    }
+    
+    //digital silence in: once everything has rung out the binaural chain is skipped until something arrives
+    const bool inputSilent = buffer.getMagnitude (0, numSamples) < silenceThreshold;
+    if (!inputSilent)
     {
+        silentSamples = 0;
+        idle = false;
+    }
+    
+    if (usingSpeakerOutput) //speaker array - VBAP, same knobs, no HRIRs
+    {
+        //gains at control rate (once a quantum), the matrix ramps between them
         const float azi   = smoothedAzi.getNextValue();
         const float ele   = smoothedEle.getNextValue();
         const float width = smoothedWidth.getNextValue();
-
+        smoothedAzi.skip(numSamples - 1);
+        smoothedEle.skip(numSamples - 1);
+        smoothedWidth.skip(numSamples - 1);
+        smoothedDistance.skip(numSamples);
+        smoothedRoom.skip(numSamples);
+        
+        const float widthOffset = (width / 100.0f) * 90.0f;
+        const float aziL = wrap360 (azi + widthOffset), aziR = wrap360 (azi - widthOffset);
+        
+        //0.707: the two sources add up, like in the other modes
+        vbap.setDirection (0, aziL, ele, 0.707f);
+        vbap.setDirection (1, aziR, ele, 0.707f);
+        
+        const float* sources[2] = { buffer.getReadPointer(0), buffer.getReadPointer(1) };
+        vbap.process (sources, buffer.getArrayOfWritePointers(), numSamples);
+        
+        for (int ch = vbap.getNumOutputs(); ch < buffer.getNumChannels(); ++ch)
+            buffer.clear (ch, 0, numSamples);
+        
+        storeRenderedPositions (aziL, ele, aziR, ele);
+    }
+    
+    else if (db != nullptr && idle)
+    {
         smoothedAzi.skip(numSamples);
         smoothedEle.skip(numSamples);
         smoothedWidth.skip(numSamples);
-      
-        const float widthOffset = (width / 100.0f) * 90.0f;
-        float aziR = wrap360 (azi - widthOffset);
-        float aziL = wrap360 (azi + widthOffset);
+        smoothedDistance.skip(numSamples);
+        smoothedRoom.skip(numSamples);
+        
+        //keep up with head tracking, draining the network FIFO too: once it's full new poses are dropped, and
+        //the scene would wake up on a stale one
+        const auto trackingMode = headTracker.getActiveMode();
+        if (trackingMode != HeadTracker::Mode::off
+             && (trackingMode == HeadTracker::Mode::midi ? headTracker.handleMidi (midiMessages, midiStart, midiEnd, headPose)
+                                                         : headTracker.pullLatest (headPose)))
+            headRotation.setPose (headPose);
+        
+        buffer.clear();
+    }
+    
+    else if (db != nullptr && usingSpeakerLayout) //surround bed on headphones - every channel is a virtual speaker
+    {
+        //the speakers stay where they are, only the head turns
+        smoothedAzi.skip(numSamples);
+        smoothedEle.skip(numSamples);
+        smoothedWidth.skip(numSamples);
+        smoothedDistance.skip(numSamples);
+        smoothedRoom.skip(numSamples);
         
+        const auto trackingMode = headTracker.getActiveMode();
+        if (trackingMode == HeadTracker::Mode::off)
+        {
+            if (!headRotation.isIdentity)
+            {
+                headPose = {};
+                headRotation.setPose (headPose);
+            }
+        }
+        //the virtual speakers render whole quanta, so the pose is read once per quantum here, not per sub-block
+        else if (trackingMode == HeadTracker::Mode::midi ? headTracker.handleMidi (midiMessages, midiStart, midiEnd, headPose)
+                                                          : headTracker.pullLatest (headPose))
+        {
+            headRotation.setPose (headPose);
+            reportPoseRendered (midiEnd, 0);
+        }
         
-        updateKernels (aziL, ele, aziR, ele);
+        speakerRenderer.update (*db, headRotation);
+        speakerRenderer.process (*db, buffer.getArrayOfReadPointers(), spatialLBuffer.getWritePointer(0), spatialLBuffer.getWritePointer(1));
         
-        spatialLBuffer.copyFrom (0, 0, buffer, 0, 0, numSamples);
-        spatialLBuffer.copyFrom (1, 0, buffer, 0, 0, numSamples);
+        //same make-up as the two-source mix below
+        const float makeUpGain = 4.0f;
+        buffer.copyFrom (0, 0, spatialLBuffer, 0, 0, numSamples);
+        buffer.copyFrom (1, 0, spatialLBuffer, 1, 0, numSamples);
+        buffer.applyGain (0, 0, numSamples, 0.707f * makeUpGain);
+        buffer.applyGain (1, 0, numSamples, 0.707f * makeUpGain);
         
-        int srcR = buffer.getNumChannels() > 1 ? 1 : 0;
-        spatialRBuffer.copyFrom (0, 0, buffer, srcR, 0, numSamples);
-        spatialRBuffer.copyFrom (1, 0, buffer, srcR, 0, numSamples);
+        for (int ch = 2; ch < buffer.getNumChannels(); ++ch)
+            buffer.clear (ch, 0, numSamples);
         
-        juce::dsp::AudioBlock<float> blockL (spatialLBuffer), blockR (spatialRBuffer);
-        convL.process (juce::dsp::ProcessContextReplacing<float>(blockL));
-        convR.process (juce::dsp::ProcessContextReplacing<float>(blockR));
+        if (inputSilent)
+        {
+            const int tailSamples = db->getIRLength();
+            silentSamples = juce::jmin (silentSamples + numSamples, tailSamples);
+            idle = silentSamples >= tailSamples && buffer.getMagnitude (0, numSamples) < silenceThreshold;
+        }
+    }
+    
+    else if (db != nullptr) //if there is a folder selected and HRIR is loaded - 3d pan mode
+    {
+        const bool propagationDelay = apvts.getRawParameterValue ("propagationDelay")->load() > 0.5f;
+        distanceL.setPropagationDelayEnabled (propagationDelay);
+        distanceR.setPropagationDelayEnabled (propagationDelay);
+        
+        const float roomSize = apvts.getRawParameterValue ("roomSize")->load();
+        const bool roomActive = smoothedRoom.getCurrentValue() > 0.0f || smoothedRoom.getTargetValue() > 0.0f;
+        
+        // with head tracking on, the scene is re-rotated every control sub-block instead of once per host block
+        const auto trackingMode = headTracker.getActiveMode();
+        const bool tracking = trackingMode != HeadTracker::Mode::off;
+        const int stepSize = tracking ? controlBlockSize : numSamples;
+        
+        if (!tracking && !headRotation.isIdentity)
+        {
+            headPose = {};
+            headRotation.setPose (headPose);
+        }
+        
+        // the shared engine delays the direct sound, keep the room behind it
+        room.setExtraDelay (usingSharedEngine ? BatchRenderEngine::latencySamples : 0);
+        
+        // the room is fed from the dry input, its own path lengths set the reflection levels
+        if (roomActive)
+        {
+            roomInputBuffer.copyFrom (0, 0, buffer, 0, 0, numSamples);
+            roomInputBuffer.addFrom (0, 0, buffer, 1, 0, numSamples);
+            roomInputBuffer.applyGain (0.5f);
+        }
+        
+        // under load each source drops to a cheaper tier, quiet ones first; the convolvers stay the full tier
+        const bool adaptive = isAdaptiveQuality() && db->hasLevelsOfDetail() && !usingSharedEngine && !usingBasis;
+        const float pressure = lodClient.getPressure();
+        lodL.setTier (adaptive ? LODGovernor::pickTier (pressure, juce::Decibels::gainToDecibels (buffer.getMagnitude (0, 0, numSamples))) : LODVoice::full);
+        lodR.setTier (adaptive ? LODGovernor::pickTier (pressure, juce::Decibels::gainToDecibels (buffer.getMagnitude (1, 0, numSamples))) : LODVoice::full);
+        const bool lodPathL = adaptive || !lodL.isAtFullQuality();
+        const bool lodPathR = adaptive || !lodR.isAtFullQuality();
+        
+        spatialLBuffer.copyFrom (0, 0, buffer, 0, 0, numSamples);
+        spatialRBuffer.copyFrom (0, 0, buffer, 1, 0, numSamples);
+        
+        for (int start = 0; start < numSamples; start += stepSize)
+        {
+            const int len = juce::jmin (stepSize, numSamples - start);
+            
+            //a MIDI pose lands on the sub-block its host sample was fed into (the first one also takes what came
+            //before it in this callback), the network FIFO is drained at every sub-block boundary
+            const int subStart = start == 0 ? midiStart : juce::jmax (midiStart, midiEnd - numSamples + start);
+            const int subEnd = juce::jmax (midiStart, midiEnd - numSamples + start + len);
+            const bool newPose = trackingMode == HeadTracker::Mode::midi ? headTracker.handleMidi (midiMessages, subStart, subEnd, headPose)
+                                                                         : (tracking && headTracker.pullLatest (headPose));
+            if (newPose)
+            {
+                headRotation.setPose (headPose);
+                reportPoseRendered (midiEnd, start);
+            }
+            
+            const float azi   = smoothedAzi.getNextValue();
+            const float ele   = smoothedEle.getNextValue();
+            const float width = smoothedWidth.getNextValue();
+
+            smoothedAzi.skip(len - 1);
+            smoothedEle.skip(len - 1);
+            smoothedWidth.skip(len - 1);
+            
+            const float distStart = smoothedDistance.getCurrentValue();
+            smoothedDistance.skip(len);
+            const float distEnd = smoothedDistance.getCurrentValue();
+            
+            const float roomStart = smoothedRoom.getCurrentValue();
+            smoothedRoom.skip(len);
+            const float roomEnd = smoothedRoom.getCurrentValue();
+          
+            const float widthOffset = (width / 100.0f) * 90.0f;
+            float aziR = wrap360 (azi - widthOffset), eleR = ele;
+            float aziL = wrap360 (azi + widthOffset), eleL = ele;
+            float aziC = azi, eleC = ele;
+            
+            // rotate the sources against the head before picking kernels
+            headRotation.apply (aziL, eleL);
+            headRotation.apply (aziR, eleR);
+            headRotation.apply (aziC, eleC);
+            
+            // at width 0 both sources sit on the same kernel and distance: convolve their sum once on the
+            // left chain, and let the right one ring out on silence before it's switched off
+            const bool coalesce = aziL == aziR && eleL == eleR;
+            if (!coalesce)
+            {
+                coalescedSamples = 0;
+                rightSourceIdle = false;
+            }
+            
+            updateKernels (*db, aziL, eleL, aziR, eleR);
+            prestageKernels (*db, azi, ele, width);
+            storeRenderedPositions (aziL, eleL, aziR, eleR);
+            
+            distanceL.setDirection (aziL, eleL);
+            distanceR.setDirection (aziR, eleR);
+            
+            auto* srcL = spatialLBuffer.getWritePointer(0) + start;
+            auto* srcRPtr = spatialRBuffer.getWritePointer(0) + start;
+            
+            if (coalesce)
+            {
+                juce::FloatVectorOperations::add (srcL, srcRPtr, len);
+                juce::FloatVectorOperations::clear (srcRPtr, len);
+            }
+            
+            // gain, air absorption and delay are per source, so run them on the mono input before it is split to both ears
+            distanceL.processInput (srcL, len, distStart, distEnd);
+            
+            // mono in, both ears out
+            if (usingBasis)
+                basisRenderer.delaySource (*db, 0, srcL, srcL, spatialLBuffer.getWritePointer(1) + start, len, kernelIndexL);
+            else if (usingSharedEngine)
+                engineVoiceL.process (srcL, srcL, spatialLBuffer.getWritePointer(1) + start, len);
+            else if (lodPathL)
+                lodL.process (convL, srcL, srcL, spatialLBuffer.getWritePointer(1) + start, len);
+            else
+                convL.process (srcL, srcL, spatialLBuffer.getWritePointer(1) + start, len);
+            
+            // near-field ILD needs the ear signals (only shelves, so on the basis path it can go before the convolution)
+            distanceL.processEars (spatialLBuffer.getWritePointer(0) + start, spatialLBuffer.getWritePointer(1) + start, len, distStart, distEnd);
+            
+            // into the shared basis channels, convolved once for both sources at the end of the quantum
+            if (usingBasis)
+            {
+                basisRenderer.mixSource (*db, 0, spatialLBuffer.getReadPointer(0) + start, spatialLBuffer.getReadPointer(1) + start, start, len, kernelIndexL);
+                spatialLBuffer.clear (0, start, len);
+                spatialLBuffer.clear (1, start, len);
+            }
+            
+            if (rightSourceIdle)
+            {
+                spatialRBuffer.clear (0, start, len);
+                spatialRBuffer.clear (1, start, len);
+            }
+            else
+            {
+                distanceR.processInput (srcRPtr, len, distStart, distEnd);
+                
+                if (usingBasis)
+                    basisRenderer.delaySource (*db, 1, srcRPtr, srcRPtr, spatialRBuffer.getWritePointer(1) + start, len, kernelIndexR);
+                else if (usingSharedEngine)
+                    engineVoiceR.process (srcRPtr, srcRPtr, spatialRBuffer.getWritePointer(1) + start, len);
+                else if (lodPathR)
+                    lodR.process (convR, srcRPtr, srcRPtr, spatialRBuffer.getWritePointer(1) + start, len);
+                else
+                    convR.process (srcRPtr, srcRPtr, spatialRBuffer.getWritePointer(1) + start, len);
+                
+                distanceR.processEars (spatialRBuffer.getWritePointer(0) + start, spatialRBuffer.getWritePointer(1) + start, len, distStart, distEnd);
+                
+                if (usingBasis)
+                    basisRenderer.mixSource (*db, 1, spatialRBuffer.getReadPointer(0) + start, spatialRBuffer.getReadPointer(1) + start, start, len, kernelIndexR);
+                
+                // once its tail is gone, park the right chain empty so widening again starts it clean
+                if (coalesce && (coalescedSamples += len) >= db->getIRLength() + distanceR.getTailLengthSamples (distEnd))
+                {
+                    rightSourceIdle = true;
+                    convR.reset();
+                    engineVoiceR.reset();
+                    lodR.reset();
+                    distanceR.reset();
+                    lastAziR = -1000.0f; lastEleR = -1000.0f;
+                    kernelIndexR = -1;
+                }
+            }
+            
+            if (roomActive)
+            {
+                room.update (*db, aziC, eleC, distEnd, roomSize, propagationDelay);
+                room.process (roomInputBuffer.getReadPointer(0) + start,
+                              spatialLBuffer.getWritePointer(0) + start, spatialLBuffer.getWritePointer(1) + start,
+                              len, roomStart, roomEnd);
+            }
+        }
         
+        //both sources' direct sound, in place of the right chain's (the left one holds the room now)
+        if (usingBasis)
+            basisRenderer.process (spatialRBuffer.getWritePointer(0), spatialRBuffer.getWritePointer(1));
         
-        buffer.setSize (2, numSamples, false, false, true);
         auto* outL = buffer.getWritePointer(0);
         auto* outR = buffer.getWritePointer(1);
         
@@ -250,6 +963,18 @@ void NewProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
             outR[s] = (spatialLBuffer.getReadPointer(1)[s] + spatialRBuffer.getReadPointer(1)[s]) * 0.707f * makeUpGain;
         }
         
+        //HRIR + distance (+ room) tail, then wait for the output itself to be gone too
+        if (inputSilent)
+        {
+            int tailSamples = db->getIRLength() * (usingBasis ? 2 : 1) + distanceL.getTailLengthSamples (smoothedDistance.getTargetValue())
+                              + (usingSharedEngine ? BatchRenderEngine::latencySamples : 0);
+            if (roomActive)
+                tailSamples += (int) ((RoomEngine::getReverbTime (roomSize) + 2.0f * roomSize / DistanceEngine::speedOfSound) * currentSampleRate);
+            
+            silentSamples = juce::jmin (silentSamples + numSamples, tailSamples);
+            idle = silentSamples >= tailSamples && buffer.getMagnitude (0, numSamples) < silenceThreshold;
+        }
+        
     }
     
     else //if no HRIR data is loaded - stereo pan
@@ -261,8 +986,12 @@ void NewProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
                 rightGain = std::sin(angle);
             };
 
+            // distance and room are only rendered in 3d mode
+            smoothedDistance.skip(numSamples);
+            smoothedRoom.skip(numSamples);
+            
             auto* inL = buffer.getReadPointer(0);
-            auto* inR = numChannels > 1 ? buffer.getReadPointer(1) : inL;
+            auto* inR = buffer.getReadPointer(1);
             auto* outL = buffer.getWritePointer(0);
             auto* outR = buffer.getWritePointer(1);
 
@@ -299,34 +1028,179 @@ void NewProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
                 outL[s] = (L * finalLL) + (R * finalRL);
                 outR[s] = (L * finalLR) + (R * finalRR);
             }
+            
+            //no 3d here, just show where the knobs point
+            const float widthOffset = (smoothedWidth.getCurrentValue() / 100.0f) * 90.0f;
+            storeRenderedPositions (smoothedAzi.getCurrentValue() + widthOffset, smoothedEle.getCurrentValue(),
+                                    smoothedAzi.getCurrentValue() - widthOffset, smoothedEle.getCurrentValue());
         }
 }
 
 void NewProjectAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    auto state = apvts.copyState();
-    state.setProperty ("hrtfPath", hrtfRoot.getFullPathName(), nullptr);
-    std::unique_ptr<juce::XmlElement> xml (state.createXml());
-    copyXmlToBinary (*xml, destData);
+    //parameters by id, so adding one later doesn't break old sessions
+    juce::MemoryOutputStream out (destData, false);
+    out.writeInt (stateMagic);
+    out.writeInt (stateVersion);
+    
+    const auto& params = getParameters();
+    out.writeCompressedInt (params.size());
+    
+    for (auto* p : params)
+    {
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*> (p);
+        out.writeString (ranged != nullptr ? ranged->getParameterID() : juce::String());
+        out.writeFloat (ranged != nullptr ? ranged->convertFrom0to1 (ranged->getValue()) : 0.0f);
+    }
+    
+    //subject A where a single set used to be, the others after everything
+    out.writeString (subjects[0].root.getFullPathName());
+    out.writeString (headphoneEQFile.getFullPathName());
+    out.writeInt64 ((juce::int64) subjects[0].contentHash.load());
+    out.writeDouble (subjects[0].contentHashRate.load());
+    
+    out.writeCompressedInt (numSubjects - 1);
+    for (size_t i = 1; i < subjects.size(); ++i)
+    {
+        out.writeString (subjects[i].root.getFullPathName());
+        out.writeInt64 ((juce::int64) subjects[i].contentHash.load());
+        out.writeDouble (subjects[i].contentHashRate.load());
+    }
 }
 
 void NewProjectAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    std::unique_ptr<juce::XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
-    if (xmlState.get() != nullptr && xmlState->hasTagName (apvts.state.getType()))
+    juce::ValueTree state (apvts.state.getType());
+    juce::String savedPaths[numSubjects], savedEQPath;
+    juce::uint64 savedHashes[numSubjects] = {};
+    double savedHashRates[numSubjects] = {};
+    
+    juce::MemoryInputStream in (data, (size_t) sizeInBytes, false);
+    
+    if (sizeInBytes >= 8 && in.readInt() == stateMagic)
     {
-        apvts.replaceState (juce::ValueTree::fromXml (*xmlState));
+        //newer versions only append, so read what this one knows about
+        if (in.readInt() < 1)
+            return;
+        
+        const int numParams = in.readCompressedInt();
+        for (int i = 0; i < numParams && !in.isExhausted(); ++i)
+        {
+            const auto id = in.readString();
+            const float value = in.readFloat();
+            state.appendChild (juce::ValueTree ("PARAM", { { "id", id }, { "value", value } }), nullptr);
+        }
+        
+        savedPaths[0] = in.readString();
+        savedEQPath = in.readString();
+        savedHashes[0] = (juce::uint64) in.readInt64();
+        savedHashRates[0] = in.readDouble();
         
-        juce::String savedPath = apvts.state.getProperty("hrtfPath", "");
-        if (savedPath.isNotEmpty())
+        //subjects B, C, D (not in sessions from before them)
+        const int numSaved = in.isExhausted() ? 0 : in.readCompressedInt();
+        for (int i = 1; i <= numSaved && !in.isExhausted(); ++i)
         {
-            hrtfRoot = juce::File(savedPath);
-            loadHRTFDatabaseToMemory(getSampleRate());
+            const auto path = in.readString();
+            const auto hash = (juce::uint64) in.readInt64();
+            const double rate = in.readDouble();
+            
+            if (i < numSubjects)
+            {
+                savedPaths[i] = path;
+                savedHashes[i] = hash;
+                savedHashRates[i] = rate;
+            }
         }
     }
+    else
+    {
+        //sessions saved before the binary format
+        std::unique_ptr<juce::XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
+        if (xmlState.get() == nullptr || !xmlState->hasTagName (apvts.state.getType()))
+            return;
+        
+        state = juce::ValueTree::fromXml (*xmlState);
+        savedPaths[0] = state.getProperty ("hrtfPath", "");
+        savedEQPath = state.getProperty ("headphoneEQPath", "");
+    }
+    
+    //parameters only, the subjects are reloaded below where the restored settings need it
+    apvts.replaceState (state);
+    
+    const auto savedEQFile = savedEQPath.isNotEmpty() ? juce::File (savedEQPath) : juce::File();
+    const bool equalisationChanged = savedEQFile != headphoneEQFile;
+    
+    //a new headphone EQ or new settings go into every subject; they're then loaded with the restored settings
+    const bool settingsChanged = loadedSettingsChanged() || equalisationChanged;
+    headphoneEQFile = savedEQFile;
+    updateLoadedSettings();
+    
+    for (int i = 0; i < numSubjects; ++i)
+    {
+        auto& s = subjects[(size_t) i];
+        const bool restored = savedPaths[i].isNotEmpty() && juce::File (savedPaths[i]) != s.root;
+        
+        //nothing to load, or the same set is already loaded (or on its way)
+        if (!restored && (!settingsChanged || s.root == juce::File()))
+            continue;
+        
+        if (restored)
+        {
+            s.root = juce::File (savedPaths[i]);
+            s.contentHash = savedHashes[i];
+            s.contentHashRate = savedHashRates[i];
+        }
+        
+        //not prepared yet, prepareToPlay loads it at the real rate
+        if (getSampleRate() <= 0.0)
+            continue;
+        
+        //hosts restore on preset scroll / undo, keep the decoding off their thread
+        loadHRTFDatabaseAsync (getSampleRate(), i, s.contentHash, s.contentHashRate);
+    }
 }
 
-void NewProjectAudioProcessor::releaseResources() {}
+double NewProjectAudioProcessor::getTailLengthSeconds() const
+{
+    //the longest of the subjects, any of them can be switched to. Only atomics from here on:
+    //hosts call this from any thread, the audio thread included, so the publishers are off limits
+    double tail = 0.0;
+    for (auto& s : subjects)
+        tail = juce::jmax (tail, s.filterSeconds.load());
+    
+    //stereo pan mode has no memory
+    const double sampleRate = getSampleRate();
+    if (tail <= 0.0 || sampleRate <= 0.0)
+        return 0.0;
+    
+    //worst case, the distance can be automated
+    if (apvts.getRawParameterValue ("propagationDelay")->load() > 0.5f)
+        tail += DistanceEngine::maxDistance / DistanceEngine::speedOfSound;
+    
+    if (apvts.getRawParameterValue ("room")->load() > 0.0f)
+    {
+        const float roomSize = apvts.getRawParameterValue ("roomSize")->load();
+        tail += RoomEngine::getReverbTime (roomSize) + 2.0f * roomSize / DistanceEngine::speedOfSound;
+    }
+    
+    tail += internalBlockSize / sampleRate;
+    if (apvts.getRawParameterValue ("sharedEngine")->load() > 0.5f)
+        tail += BatchRenderEngine::latencySamples / sampleRate;
+    
+    return tail;
+}
+
+void NewProjectAudioProcessor::releaseResources()
+{
+    juce::Logger::writeToLog ("Slowest callback: " + juce::String (realtimeSafety.getWorstCallbackSeconds() * 1000.0, 3) + " ms ("
+        + juce::String (realtimeSafety.getWorstCallbackLoad() * 100.0, 1) + "% of the time it covered), realtime violations: "
+        + juce::String (RealtimeSafetyChecker::getNumViolations()) + ", major page faults on the audio thread: "
+        + juce::String (audioThreadMajorFaults.load()));
+    DBG("Head tracking, worst pose arrival to render: " + juce::String (headTracker.getWorstRenderLatencyMs(), 2) + " ms, to output: "
+        + juce::String (headTracker.getWorstOutputLatencyMs(), 2) + " ms");
+    realtimeSafety.resetWorstCallback();
+    headTracker.resetLatencyStats();
+}
 
 bool NewProjectAudioProcessor::hasEditor() const { return true; }
 
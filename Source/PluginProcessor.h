@@ -1,7 +1,21 @@
 #pragma once
 #include <JuceHeader.h>
+#include "HRTFDatabase.h"
+#include "HRTFDatabasePublisher.h"
+#include "DistanceEngine.h"
+#include "RoomEngine.h"
+#include "HeadTracker.h"
+#include "BatchRenderEngine.h"
+#include "PartitionedConvolver.h"
+#include "VirtualSpeakerRenderer.h"
+#include "VBAPPanner.h"
+#include "BasisRenderer.h"
+#include "LevelOfDetail.h"
+#include "RealtimeSafety.h"
 
-class NewProjectAudioProcessor  : public juce::AudioProcessor
+class NewProjectAudioProcessor  : public juce::AudioProcessor,
+                                  private juce::AudioProcessorValueTreeState::Listener,
+                                  private juce::AsyncUpdater
 {
 public:
 
@@ -16,10 +30,11 @@ public:
     bool hasEditor() const override;
 
     const juce::String getName() const override { return JucePlugin_Name; }
-    bool acceptsMidi() const override { return false; }
+    bool acceptsMidi() const override { return true; } // head-tracking CCs
     bool producesMidi() const override { return false; }
     bool isMidiEffect() const override { return false; }
-    double getTailLengthSeconds() const override { return 0.0; }
+    bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
+    double getTailLengthSeconds() const override;
 
     int getNumPrograms() override { return 1; }
     int getCurrentProgram() override { return 0; }
@@ -30,57 +45,189 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
+    //listening tests: up to four subjects stay loaded side by side, the "subject" parameter picks the one that's heard
+    static constexpr int numSubjects = 4;
+    int getSelectedSubject() const;
+    
+    //the folder / set of the selected subject
     void setHRTFDirectory (const juce::File& newDir);
-    juce::File getHRTFDirectory() const { return hrtfRoot; }
+    juce::File getHRTFDirectory() const { return subjects[(size_t) getSelectedSubject()].root; }
+    
+    int getHRTFCacheSize() const { auto db = getDatabase(); return db != nullptr ? db->getNumIRs() : 0; }
+    std::shared_ptr<const HRTFDatabase> getDatabase() const { return subjects[(size_t) getSelectedSubject()].publisher.getLatest(); }
     
-    int getHRTFCacheSize() const { return (int)hrtfCache.size(); }
+    //where the two sources were last rendered (head-relative), for the editor; lock-free from any thread
+    struct RenderedPositions { float aziL, eleL, aziR, eleR; };
+    RenderedPositions getRenderedPositions() const noexcept;
     
     void clearHRTFDirectory();
+    
+    //headphone correction FIR, baked into the HRIRs on load (empty file = none)
+    void setHeadphoneEQFile (const juce::File& newFile);
+    juce::File getHeadphoneEQFile() const { return headphoneEQFile; }
 
     juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
+    
+    HeadTracker& getHeadTracker() { return headTracker; }
+    
+    //slowest callback since the last releaseResources (violations are counted process-wide, see RealtimeSafety.h)
+    const RealtimeSafetyChecker& getRealtimeSafety() const { return realtimeSafety; }
+    
+    //page faults that went to disk inside processBlock, counted while Lock Memory is on
+    juce::int64 getAudioThreadMajorFaults() const { return audioThreadMajorFaults.load(); }
 
 private:
-   
-    struct HRTFRecord
+    
+    //one subject's set, loaded on the message thread, handed to processBlock without locks (see HRTFDatabasePublisher).
+    //subjects in the same folder share one database, like instances do (see HRTFDatabase::loadShared)
+    struct Subject
     {
-        float azimuth;
-        float elevation;
-        //juce::File file;
-       
-        juce::AudioBuffer<float> irData;
-        double sampleRate;
+        juce::File root;
+        HRTFDatabasePublisher publisher;
+        std::atomic<uint32_t> loadRequest { 0 };
+        
+        //fingerprint of the set root points at (the saved one while a restore is still loading)
+        std::atomic<juce::uint64> contentHash { 0 };
+        std::atomic<double> contentHashRate { 0.0 };
+        
+        //how long the published set's filters ring, set on publish: hosts ask getTailLengthSeconds from any thread
+        std::atomic<double> filterSeconds { 0.0 };
+        
+        //opt-in, see updateMemoryLock; declared last so it's unlocked before the set goes
+        MemoryLock::Set locked;
     };
+    std::array<Subject, numSubjects> subjects;
     
-    juce::File hrtfRoot;
-    std::vector<HRTFRecord> hrtfCache;
+    int lastSubject = 0;
+    uint32_t lastDatabaseVersion = 0;
+    bool hadDatabase = false;
+    
+    juce::File headphoneEQFile;
+    bool loadedWithDiffuseField = false;
+    int loadedBasisComponents = 0;
+    HRTFDatabase::SampleFormat loadedSampleFormat = HRTFDatabase::SampleFormat::float32;
+    bool loadedLevelsOfDetail = false;
     double currentSampleRate = 44100.0;
     
     
 
+    //four 16 bit angles in one word, so a reader always gets a matching set
+    std::atomic<juce::uint64> renderedPositions { 0 };
+    void storeRenderedPositions (float aziL, float eleL, float aziR, float eleR) noexcept;
+    
     float lastAziL = -1000.0f, lastEleL = -1000.0f;
     float lastAziR = -1000.0f, lastEleR = -1000.0f;
+    int kernelIndexL = -1, kernelIndexR = -1;
+    std::array<float, HRTFDatabase::fetchScratchSize> kernelScratch; //16-bit sets are widened into here
 
     
+    //host blocks are re-cut into fixed quanta (one convolver partition, FFT size 256) through a FIFO of
+    //one quantum, which is the latency; nothing is sized by, or resized for, the host block
+    static constexpr int internalBlockSize = 128;
+    juce::AudioBuffer<float> fifoIn, fifoOut;
+    int fifoPos = 0;
+    void processQuantum (juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages, int midiStart, int midiEnd);
+    
     juce::AudioBuffer<float> spatialLBuffer;
     juce::AudioBuffer<float> spatialRBuffer;
 
+    //every subject with the current settings, or one of them with the settings the others were loaded with
     void loadHRTFDatabaseToMemory (double sampleRate);
-    void updateKernels (float aziL, float eleL, float aziR, float eleR);
-    const HRTFRecord* findBestMatch (float azi, float ele) const;
+    void loadHRTFDatabaseToMemory (double sampleRate, int subject);
+    void updateLoadedSettings();
+    bool loadedSettingsChanged() const;
+    HRTFDatabase::Equalisation getLoadedEqualisation() const;
+    
+    //state restores load in the background; only the newest request per subject gets to publish
+    void loadHRTFDatabaseAsync (double sampleRate, int subject, juce::uint64 savedHash, double savedHashRate);
+    bool publishIfLatest (int subject, uint32_t request, std::shared_ptr<const HRTFDatabase> db);
+    juce::ThreadPool loaderPool { 1 };
+    juce::CriticalSection loadLock;
+    
+    //binary state: magic, version, then fields that are only ever appended to
+    static constexpr juce::int32 stateMagic = 0x50443341; // "A3DP"
+    static constexpr juce::int32 stateVersion = 1;
+    HRTFDatabase::Equalisation getEqualisation() const;
+    int getBasisComponents() const;
+    HRTFDatabase::SampleFormat getSampleFormat() const;
+    bool isAdaptiveQuality() const;
+    size_t getMemoryLockCeiling() const;
+    
+    //reload when the diffuse-field switch / basis size / storage format / quality mode changes, re-report latency when the shared engine is switched,
+    //relock when the memory ceiling changes
+    void parameterChanged (const juce::String& parameterID, float newValue) override;
+    void handleAsyncUpdate() override;
+    void updateLatency();
+    void updateKernels (const HRTFDatabase& db, float aziL, float eleL, float aziR, float eleR);
+    
+    //warm the kernels the next sub-blocks are heading for, so switching to them costs nothing
+    static constexpr int lookaheadSteps = 3;
+    void prestageKernels (const HRTFDatabase& db, float azi, float ele, float width);
     
     //smooth parameters
     juce::LinearSmoothedValue<float> smoothedAzi;
     juce::LinearSmoothedValue<float> smoothedEle;
     juce::LinearSmoothedValue<float> smoothedWidth;
+    juce::LinearSmoothedValue<float> smoothedDistance;
+    juce::LinearSmoothedValue<float> smoothedRoom;
+    
+    //distance cues for the two virtual sources
+    DistanceEngine distanceL, distanceR;
+    
+    //skip the whole binaural chain once the input is silent and the tail has died away
+    static constexpr float silenceThreshold = 1.0e-5f; // -100 dB
+    int silentSamples = 0;
+    bool idle = false;
+    
+    //width 0: both sources share the left chain, the right one is switched off once it has rung out
+    int coalescedSamples = 0;
+    bool rightSourceIdle = false;
+    
+    //early reflections + one late tail shared by both sources
+    RoomEngine room;
+    juce::AudioBuffer<float> roomInputBuffer;
+    
+    //head tracking, the scene is rotated against the head every control sub-block
+    static constexpr int controlBlockSize = 64;
+    HeadTracker headTracker;
+    HeadPose headPose;
+    HeadRotation headRotation;
+    void reportPoseRendered (int quantumEnd, int offset) noexcept;
     
     //set latency
     //I tried zero latency, but when I listened to it in Ableton, I still felt there was phase cancellation.  The minimum latency I could set in JUCE convolution was 512 samples, so I set them to a 512-sample delay.
     //But the thing is it create a zipper noise when rotate the knob
-//    juce::dsp::Convolution convL { juce::dsp::Convolution::Latency { 512 } };
-//    juce::dsp::Convolution convR { juce::dsp::Convolution::Latency { 512 } };
+    //juce::dsp::Convolution is gone now, the own convolver has no latency and crossfades every kernel change
+    PartitionedConvolver convL, convR;
+    
+    //opt-in: hand the convolution to the process-wide engine shared with the other instances
+    BatchRenderEngine::Voice engineVoiceL, engineVoiceR;
+    bool usingSharedEngine = false;
+    
+    //5.1 / 7.1 / 7.1.4 ... in: one engine renders every channel from its speaker position
+    VirtualSpeakerRenderer speakerRenderer;
+    bool usingSpeakerLayout = false;
+    
+    //speaker layout out (more than two channels): the two sources are panned with VBAP instead
+    VBAPPanner vbap;
+    bool usingSpeakerOutput = false;
+    
+    //opt-in: both sources weighted into the set's principal components, convolved once (see BasisRenderer)
+    BasisRenderer basisRenderer;
+    bool usingBasis = false;
+    
+    //opt-in: under CPU pressure the convolvers give way to cheaper tiers per source (see LevelOfDetail.h)
+    LODVoice lodL, lodR;
+    LODGovernor::Client lodClient;
+    
+    RealtimeSafetyChecker realtimeSafety;
     
-    juce::dsp::Convolution convL, convR;
-    //But there is still zipper noise....
+    //opt-in: the subjects' databases and every audio thread buffer prefaulted and locked in RAM (see MemoryLock);
+    //declared after everything they point into, so they're unlocked first
+    MemoryLock::Set lockedBuffers;
+    std::atomic<size_t> lockedCeiling { 0 };
+    std::atomic<juce::int64> audioThreadMajorFaults { 0 };
+    void updateMemoryLock();
 
     juce::AudioProcessorValueTreeState apvts;
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
@@ -0,0 +1,78 @@
+#include "RealtimeSafety.h"
+
+namespace {
+    // plain ints, no dynamic initialisation: safe to touch from operator new at any point of a thread's life
+    thread_local int callbackDepth = 0;
+
+   #if ANNIE_REALTIME_CHECKS
+    thread_local bool reporting = false, reportedThisCallback = false;
+    std::atomic<int> numViolations { 0 };
+
+    static void violation (const char* what) noexcept {
+        if (callbackDepth == 0 || reporting)
+            return;
+
+        ++numViolations;
+
+        if (reportedThisCallback)
+            return;
+
+        // the report (and the assertion's own log line) allocates and writes, keep it out of the check
+        reporting = true;
+        reportedThisCallback = true;
+        juce::Logger::outputDebugString (juce::String ("Realtime violation in the audio callback: ") + what + "\n"
+                                         + juce::SystemStats::getStackBacktrace());
+        jassertfalse;
+        reporting = false;
+    }
+   #endif
+}
+
+RealtimeSafetyChecker::CallbackScope::CallbackScope (RealtimeSafetyChecker& owner, double secondsAvailable) noexcept
+    : checker (owner), available (secondsAvailable), startTicks (juce::Time::getHighResolutionTicks())
+{
+   #if ANNIE_REALTIME_CHECKS
+    if (callbackDepth == 0)
+        reportedThisCallback = false;
+   #endif
+
+    ++callbackDepth;
+}
+
+RealtimeSafetyChecker::CallbackScope::~CallbackScope() noexcept
+{
+    --callbackDepth;
+
+    const double seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+
+    // only ever one audio thread per instance, nobody else writes these
+    if (seconds > checker.worstSeconds.load (std::memory_order_relaxed))
+        checker.worstSeconds.store (seconds, std::memory_order_relaxed);
+
+    const double load = available > 0.0 ? seconds / available : 0.0;
+    if (load > checker.worstLoad.load (std::memory_order_relaxed))
+        checker.worstLoad.store (load, std::memory_order_relaxed);
+}
+
+void RealtimeSafetyChecker::assertNotAudioThread (const char* what) noexcept
+{
+   #if ANNIE_REALTIME_CHECKS
+    violation (what);
+   #else
+    juce::ignoreUnused (what);
+   #endif
+}
+
+bool RealtimeSafetyChecker::isInsideCallback() noexcept
+{
+    return callbackDepth > 0;
+}
+
+int RealtimeSafetyChecker::getNumViolations() noexcept
+{
+   #if ANNIE_REALTIME_CHECKS
+    return numViolations.load();
+   #else
+    return 0;
+   #endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Keeps the audio callback honest about being realtime-safe. While a CallbackScope is alive on a
+// thread, every call into one of the blocking paths that ask assertNotAudioThread() - the loader and
+// publisher locks, the shared engine's voice lock, file loading - is a violation: the stack it came
+// from is logged and a jassert fires, once per callback.
+//
+// The plugin itself leaves the allocator and the system alone. The test runner (Tests/) interposes
+// operator new / delete, the mutex and wait calls and blocking syscalls, and routes them through
+// assertNotAudioThread() too, so there every one of them inside processBlock is a violation.
+//
+// The checks are compiled in with ANNIE_REALTIME_CHECKS, which follows JUCE_DEBUG unless the
+// project sets it (the test runner always does); without them only the callback timing is left.
+#ifndef ANNIE_REALTIME_CHECKS
+ #define ANNIE_REALTIME_CHECKS JUCE_DEBUG
+#endif
+
+class RealtimeSafetyChecker
+{
+public:
+    // audio thread: wraps one callback, times it against the real time it has to cover
+    class CallbackScope
+    {
+    public:
+        CallbackScope (RealtimeSafetyChecker& owner, double secondsAvailable) noexcept;
+        ~CallbackScope() noexcept;
+
+    private:
+        RealtimeSafetyChecker& checker;
+        const double available;
+        const juce::int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE (CallbackScope)
+    };
+
+    // Slowest callback so far, in seconds and as a share of the time it covered
+    double getWorstCallbackSeconds() const noexcept { return worstSeconds.load(); }
+    double getWorstCallbackLoad() const noexcept { return worstLoad.load(); }
+    void resetWorstCallback() noexcept { worstSeconds = 0.0; worstLoad = 0.0; }
+
+    // For code that may block (locks, I/O, waiting on other threads): a violation if the calling
+    // thread is inside a callback.
+    static void assertNotAudioThread (const char* what) noexcept;
+    static bool isInsideCallback() noexcept;
+
+    // violations process-wide since it started
+    static int getNumViolations() noexcept;
+
+private:
+    std::atomic<double> worstSeconds { 0.0 }, worstLoad { 0.0 };
+};
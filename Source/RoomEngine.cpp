@@ -0,0 +1,328 @@
+#include "RoomEngine.h"
+#include "DistanceEngine.h"
+
+namespace {
+    constexpr int maxErTaps = 256;
+    constexpr float wallReflection = 0.7f;
+    constexpr float absorption = 0.3f; // average Sabine absorption for the tail
+    constexpr float tailInputGain = 0.5f;
+    constexpr float tailOutputGain = 0.25f;
+
+    // mutually prime-ish lengths for a 10 m room at 44.1 kHz
+    constexpr std::array<int, RoomEngine::numTailLines> tailBaseLengths { 1031, 1327, 1523, 1801, 2053, 2333, 2617, 2903 };
+
+    static inline float wrap360 (float a) {
+        while (a < 0.0f) a += 360.0f;
+        while (a >= 360.0f) a -= 360.0f;
+        return a;
+    }
+
+    static inline void hadamard8 (float* v) {
+        for (int h = 1; h < 8; h *= 2)
+            for (int i = 0; i < 8; i += h * 2)
+                for (int j = i; j < i + h; ++j)
+                {
+                    const float a = v[j], b = v[j + h];
+                    v[j] = a + b;
+                    v[j + h] = a - b;
+                }
+
+        for (int i = 0; i < 8; ++i)
+            v[i] *= 0.35355339f; // 1 / sqrt (8)
+    }
+}
+
+void RoomEngine::prepare (double newSampleRate, int maxBlockSize)
+{
+    sampleRate = newSampleRate;
+    maxBlock = juce::jmax (1, maxBlockSize);
+
+    // longest image path: furthest source plus a trip across the biggest room and back
+    const float maxPath = DistanceEngine::maxDistance + 2.0f * maxRoomSize;
+    const int erSize = juce::nextPowerOfTwo ((int) std::ceil (maxPath / DistanceEngine::speedOfSound * sampleRate) + maxBlock + 2);
+    erLine.assign ((size_t) erSize, 0.0f);
+    erMask = erSize - 1;
+
+    for (auto& r : reflections)
+    {
+        r.kernelL.assign (maxErTaps, 0.0f);
+        r.kernelR.assign (maxErTaps, 0.0f);
+        r.previousKernelL.assign (maxErTaps, 0.0f);
+        r.previousKernelR.assign (maxErTaps, 0.0f);
+        r.history.assign ((size_t) (maxErTaps - 1 + maxBlock), 0.0f);
+    }
+
+    erOutL.assign ((size_t) maxBlock, 0.0f);
+    erOutR.assign ((size_t) maxBlock, 0.0f);
+    irScratch.assign ((size_t) HRTFDatabase::fetchScratchSize, 0.0f);
+
+    const float maxScale = maxRoomSize / 10.0f * (float) (sampleRate / 44100.0);
+    const int tailSize = juce::nextPowerOfTwo ((int) std::ceil (tailBaseLengths.back() * maxScale) + 1);
+    for (auto& line : tailLines)
+        line.assign ((size_t) tailSize, 0.0f);
+    tailMask = tailSize - 1;
+
+    // gentle high frequency damping inside the loop
+    tailDamp = std::exp (-juce::MathConstants<float>::twoPi * 6000.0f / (float) sampleRate);
+
+    reset();
+}
+
+void RoomEngine::reset()
+{
+    std::fill (erLine.begin(), erLine.end(), 0.0f);
+    erWrite = 0;
+
+    for (auto& r : reflections)
+    {
+        std::fill (r.history.begin(), r.history.end(), 0.0f);
+        r.previousDelay = r.delay;
+        r.previousGain = r.gain;
+        r.kernelChanged = false;
+    }
+
+    for (auto& line : tailLines)
+        std::fill (line.begin(), line.end(), 0.0f);
+    tailDampState.fill (0.0f);
+    tailWrite = 0;
+}
+
+void RoomEngine::lockInMemory (MemoryLock::Set& set) const
+{
+    auto add = [&set] (const std::vector<float>& v) { set.add (v.data(), v.size() * sizeof (float)); };
+
+    add (erLine);
+    add (erOutL);
+    add (erOutR);
+    add (irScratch);
+
+    for (auto& r : reflections)
+        for (auto* v : { &r.kernelL, &r.kernelR, &r.previousKernelL, &r.previousKernelR, &r.history })
+            add (*v);
+
+    for (auto& line : tailLines)
+        add (line);
+}
+
+void RoomEngine::update (const HRTFDatabase& db, float azimuthDeg, float elevationDeg, float distance,
+                         float roomSize, bool absoluteDelay)
+{
+    if (db.getNumIRs() == 0)
+        return;
+
+    const bool databaseChanged = db.getIRLength() != lastIRLength || db.getNumIRs() != lastNumIRs;
+    const bool crossfade = databaseChanged && db.getIRLength() == crossfadeIRLength;
+    crossfadeIRLength = 0;
+
+    if (!databaseChanged
+        && std::abs (azimuthDeg - lastAzi) < 0.5f && std::abs (elevationDeg - lastEle) < 0.5f
+        && std::abs (distance - lastDistance) < 0.05f && std::abs (roomSize - lastSize) < 0.05f
+        && absoluteDelay == lastAbsolute)
+        return;
+
+    lastAzi = azimuthDeg; lastEle = elevationDeg; lastDistance = distance; lastSize = roomSize;
+    lastAbsolute = absoluteDelay;
+    lastIRLength = db.getIRLength(); lastNumIRs = db.getNumIRs();
+
+    erTaps = juce::jlimit (1, maxErTaps, db.getIRLength() / 4);
+
+    // shoebox with the listener a little off-centre, so opposite walls don't arrive together
+    const auto [lx, ly, lz] = roomDimensions (roomSize);
+    const float floorZ = -juce::jmin (1.2f, lz * 0.5f);
+
+    struct Wall { int axis; float position; };
+    const std::array<Wall, numReflections> walls {{ { 0,  0.55f * lx }, { 0, -0.45f * lx },
+                                                    { 1,  0.42f * ly }, { 1, -0.58f * ly },
+                                                    { 2,  floorZ + lz }, { 2,  floorZ } }};
+
+    auto dir = HRTFDatabase::toUnitVector (azimuthDeg, elevationDeg) * juce::jmax (DistanceEngine::minDistance, distance);
+    float source[3] = { dir.x, dir.y, dir.z };
+
+    // keep the source inside the room
+    const float lo[3] = { walls[1].position, walls[3].position, walls[5].position };
+    const float hi[3] = { walls[0].position, walls[2].position, walls[4].position };
+    for (int a = 0; a < 3; ++a)
+        source[a] = juce::jlimit (lo[a] + 0.1f, hi[a] - 0.1f, source[a]);
+
+    const float directPath = std::sqrt (source[0] * source[0] + source[1] * source[1] + source[2] * source[2]);
+    const float samplesPerMetre = (float) sampleRate / DistanceEngine::speedOfSound;
+    int longestDelay = 0;
+
+    for (int w = 0; w < numReflections; ++w)
+    {
+        float image[3] = { source[0], source[1], source[2] };
+        image[walls[(size_t) w].axis] = 2.0f * walls[(size_t) w].position - image[walls[(size_t) w].axis];
+
+        const float path = std::sqrt (image[0] * image[0] + image[1] * image[1] + image[2] * image[2]);
+        const float imageAzi = wrap360 (juce::radiansToDegrees (std::atan2 (image[1], image[0])));
+        const float imageEle = juce::radiansToDegrees (std::asin (juce::jlimit (-1.0f, 1.0f, image[2] / path)));
+
+        auto& r = reflections[(size_t) w];
+        r.delay = juce::jlimit (0, erMask - maxBlock, (int) std::lround ((absoluteDelay ? path : path - directPath) * samplesPerMetre) + extraDelay);
+        r.gain = wallReflection * DistanceEngine::referenceDistance / juce::jmax (DistanceEngine::minDistance, path);
+        longestDelay = juce::jmax (longestDelay, r.delay);
+
+        const int index = db.findNearest (imageAzi, imageEle);
+        if (index != r.irIndex || databaseChanged)
+        {
+            std::swap (r.kernelL, r.previousKernelL);
+            std::swap (r.kernelR, r.previousKernelR);
+
+            // truncated HRIR with a short fade so the cut doesn't ring; normalised like the direct path's
+            // kernel (over the whole IR), so the room sits at the same level against it whatever the set's scale
+            const auto ir = db.fetchIR (index, irScratch.data());
+            const float gain = HRTFDatabase::getKernelGain (ir.left, ir.right, db.getIRLength());
+            const int fadeLen = juce::jmin (16, erTaps);
+            for (int k = 0; k < erTaps; ++k)
+            {
+                const int fromEnd = erTaps - 1 - k;
+                const float fade = fromEnd < fadeLen ? 0.5f - 0.5f * std::cos (juce::MathConstants<float>::pi * (float) fromEnd / (float) fadeLen) : 1.0f;
+                r.kernelL[(size_t) k] = ir.left[k] * fade * gain;
+                r.kernelR[(size_t) k] = ir.right[k] * fade * gain;
+            }
+
+            // a different database can't crossfade from the old kernels (unless they're as long), just start clean
+            r.kernelChanged = (!databaseChanged || crossfade) && r.irIndex >= 0;
+            if (databaseChanged && !crossfade)
+                std::fill (r.history.begin(), r.history.end(), 0.0f);
+
+            r.irIndex = index;
+        }
+    }
+
+    tailPredelay = longestDelay;
+
+    updateTail (roomSize, getReverbTime (roomSize));
+}
+
+std::array<float, 3> RoomEngine::roomDimensions (float roomSize) noexcept
+{
+    return { roomSize, roomSize * 0.8f, juce::jlimit (2.5f, 8.0f, roomSize * 0.35f) };
+}
+
+float RoomEngine::getReverbTime (float roomSize) noexcept
+{
+    // Sabine estimate with a fixed average absorption
+    const auto [lx, ly, lz] = roomDimensions (roomSize);
+    const float volume = lx * ly * lz;
+    const float surface = 2.0f * (lx * ly + lx * lz + ly * lz);
+    return 0.161f * volume / (surface * absorption);
+}
+
+void RoomEngine::updateTail (float roomSize, float rt60)
+{
+    const float scale = roomSize / 10.0f * (float) (sampleRate / 44100.0);
+
+    for (int i = 0; i < numTailLines; ++i)
+    {
+        tailLengths[(size_t) i] = juce::jlimit (64, tailMask, (int) ((float) tailBaseLengths[(size_t) i] * scale));
+        tailFeedback[(size_t) i] = std::pow (10.0f, -3.0f * (float) tailLengths[(size_t) i] / (rt60 * (float) sampleRate));
+    }
+}
+
+void RoomEngine::renderReflection (Reflection& r, int numSamples)
+{
+    if (r.irIndex < 0)
+        return;
+
+    float* x = r.history.data() + (erTaps - 1);
+    const bool delayChanged = r.delay != r.previousDelay;
+
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const float t = (float) (s + 1) / (float) numSamples;
+        const int pos = erWrite + s;
+
+        float tap = erLine[(size_t) ((pos - r.delay) & erMask)];
+        if (delayChanged)
+            tap = tap * t + erLine[(size_t) ((pos - r.previousDelay) & erMask)] * (1.0f - t);
+
+        x[s] = tap * (r.previousGain + (r.gain - r.previousGain) * t);
+    }
+
+    for (int s = 0; s < numSamples; ++s)
+    {
+        float accL = 0.0f, accR = 0.0f;
+        for (int k = 0; k < erTaps; ++k)
+        {
+            accL += r.kernelL[(size_t) k] * x[s - k];
+            accR += r.kernelR[(size_t) k] * x[s - k];
+        }
+
+        // crossfade from the old direction's kernel over this block
+        if (r.kernelChanged)
+        {
+            float oldL = 0.0f, oldR = 0.0f;
+            for (int k = 0; k < erTaps; ++k)
+            {
+                oldL += r.previousKernelL[(size_t) k] * x[s - k];
+                oldR += r.previousKernelR[(size_t) k] * x[s - k];
+            }
+
+            const float t = (float) (s + 1) / (float) numSamples;
+            accL = oldL + (accL - oldL) * t;
+            accR = oldR + (accR - oldR) * t;
+        }
+
+        erOutL[(size_t) s] += accL;
+        erOutR[(size_t) s] += accR;
+    }
+
+    // keep the last erTaps - 1 inputs for the next block
+    std::copy (x + numSamples - (erTaps - 1), x + numSamples, r.history.begin());
+
+    r.previousDelay = r.delay;
+    r.previousGain = r.gain;
+    r.kernelChanged = false;
+}
+
+void RoomEngine::process (const float* monoIn, float* outL, float* outR, int numSamples,
+                          float startAmount, float endAmount)
+{
+    // hosts can send bigger blocks than announced, so work in chunks of what we prepared for
+    for (int start = 0; start < numSamples; start += maxBlock)
+    {
+        const int n = juce::jmin (maxBlock, numSamples - start);
+        const float a0 = startAmount + (endAmount - startAmount) * (float) start / (float) numSamples;
+        const float a1 = startAmount + (endAmount - startAmount) * (float) (start + n) / (float) numSamples;
+
+        for (int s = 0; s < n; ++s)
+            erLine[(size_t) ((erWrite + s) & erMask)] = monoIn[start + s];
+
+        std::fill (erOutL.begin(), erOutL.begin() + n, 0.0f);
+        std::fill (erOutR.begin(), erOutR.begin() + n, 0.0f);
+
+        for (auto& r : reflections)
+            renderReflection (r, n);
+
+        for (int s = 0; s < n; ++s)
+        {
+            const float in = erLine[(size_t) ((erWrite + s - tailPredelay) & erMask)] * tailInputGain;
+
+            float v[numTailLines];
+            for (int i = 0; i < numTailLines; ++i)
+            {
+                const float read = tailLines[(size_t) i][(size_t) ((tailWrite - tailLengths[(size_t) i]) & tailMask)];
+                tailDampState[(size_t) i] = read + tailDamp * (tailDampState[(size_t) i] - read);
+                v[i] = tailDampState[(size_t) i] * tailFeedback[(size_t) i];
+            }
+
+            // two different sign patterns give decorrelated ears
+            const float tailL = v[0] - v[1] + v[2] - v[3] + v[4] - v[5] + v[6] - v[7];
+            const float tailR = v[0] + v[1] - v[2] - v[3] + v[4] + v[5] - v[6] - v[7];
+
+            hadamard8 (v);
+
+            for (int i = 0; i < numTailLines; ++i)
+                tailLines[(size_t) i][(size_t) tailWrite] = v[i] + ((i & 1) ? -in : in);
+
+            tailWrite = (tailWrite + 1) & tailMask;
+
+            const float amount = a0 + (a1 - a0) * (float) (s + 1) / (float) n;
+            outL[start + s] += amount * (erOutL[(size_t) s] + tailOutputGain * tailL);
+            outR[start + s] += amount * (erOutR[(size_t) s] + tailOutputGain * tailR);
+        }
+
+        erWrite = (erWrite + n) & erMask;
+    }
+}
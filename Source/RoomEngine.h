@@ -0,0 +1,87 @@
+#pragma once
+#include <JuceHeader.h>
+#include "HRTFDatabase.h"
+
+// Optional room stage for the binaural mode, so the dry HRIR convolution doesn't sound "in the head".
+//  - early reflections: the six first-order image sources of a shoebox room, each rendered
+//    through a truncated HRIR from the loaded database (kernels are picked per block, not per sample)
+//  - late tail: one 8-line feedback delay network shared by both virtual sources
+// Both follow the same azimuth / elevation / distance parameters as the direct sound.
+class RoomEngine
+{
+public:
+    static constexpr int numReflections = 6;
+    static constexpr int numTailLines = 8;
+    static constexpr float minRoomSize = 3.0f;
+    static constexpr float maxRoomSize = 30.0f;
+
+    void prepare (double sampleRate, int maxBlockSize);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const;
+
+    // Forces the next update() to pick fresh kernels, e.g. after the database was reloaded.
+    void invalidateKernels() noexcept { lastIRLength = 0; lastNumIRs = 0; crossfadeIRLength = 0; }
+
+    // Same for a switch to another database of the same IR length (another subject): the reflections
+    // keep their input and crossfade from the old kernels instead of starting clean.
+    void crossfadeToNewDatabase() noexcept { const int length = lastIRLength; invalidateKernels(); crossfadeIRLength = length; }
+
+    // Pushes the whole room back by a fixed number of samples, to stay behind a direct path that has processing latency.
+    void setExtraDelay (int samples) noexcept { if (samples != extraDelay) { extraDelay = samples; lastSize = -1.0f; } }
+
+    // Recomputes the image sources and reflection kernels. Cheap when nothing moved.
+    // With absoluteDelay the reflections include the full travel time (to line up with
+    // a direct path that has propagation delay on), otherwise they're relative to the direct sound.
+    void update (const HRTFDatabase& db, float azimuthDeg, float elevationDeg, float distance,
+                 float roomSize, bool absoluteDelay);
+
+    // Adds the binaural room signal for monoIn onto the two ears.
+    void process (const float* monoIn, float* outL, float* outR, int numSamples,
+                  float startAmount, float endAmount);
+
+    // RT60 of the tail for a given room size, in seconds
+    static float getReverbTime (float roomSize) noexcept;
+
+private:
+    struct Reflection
+    {
+        int delay = 0, previousDelay = 0;
+        float gain = 0.0f, previousGain = 0.0f;
+        int irIndex = -1;
+        bool kernelChanged = false;
+
+        std::vector<float> kernelL, kernelR, previousKernelL, previousKernelR;
+        std::vector<float> history; // erTaps - 1 samples of past input, then the current block
+    };
+
+    static std::array<float, 3> roomDimensions (float roomSize) noexcept;
+    void updateTail (float roomSize, float rt60);
+    void renderReflection (Reflection& r, int numSamples);
+
+    double sampleRate = 44100.0;
+    int maxBlock = 0;
+    int erTaps = 0;
+
+    float lastAzi = -1000.0f, lastEle = -1000.0f, lastDistance = -1.0f, lastSize = -1.0f;
+    int lastIRLength = 0, lastNumIRs = 0;
+    int crossfadeIRLength = 0;
+    int extraDelay = 0;
+    bool lastAbsolute = false;
+
+    // shared mono delay line the reflections tap from
+    std::vector<float> erLine;
+    int erMask = 0, erWrite = 0;
+
+    std::array<Reflection, numReflections> reflections;
+    std::vector<float> erOutL, erOutR, firScratch;
+    std::vector<float> irScratch; // widened HRIRs of 16-bit sets
+
+    // late tail
+    std::array<std::vector<float>, numTailLines> tailLines;
+    std::array<int, numTailLines> tailLengths {};
+    std::array<float, numTailLines> tailFeedback {}, tailDampState {};
+    int tailMask = 0, tailWrite = 0, tailPredelay = 0;
+    float tailDamp = 0.0f;
+};
@@ -0,0 +1,157 @@
+#include "SphereView.h"
+#include "PluginProcessor.h"
+
+namespace {
+    const juce::Colour background (0xFF14FFDC); // same neon cyan as the editor
+}
+
+SphereView::SphereView (NewProjectAudioProcessor& p)
+    : audioProcessor (p)
+{
+    setOpaque (true);
+
+    const auto positions = audioProcessor.getRenderedPositions();
+    shown = { positions.aziL, positions.eleL, positions.aziR, positions.eleR };
+
+    startTimerHz (frameRateHz);
+}
+
+SphereView::~SphereView()
+{
+    stopTimer();
+}
+
+void SphereView::resized()
+{
+    auto bounds = getLocalBounds().toFloat().reduced (4.0f);
+    topArea = bounds.removeFromLeft (bounds.getWidth() * 0.5f).reduced (4.0f);
+    sideArea = bounds.reduced (4.0f);
+
+    staticLayerDirty = true;
+}
+
+juce::Point<float> SphereView::topPoint (float azimuthDeg, float elevationDeg) const
+{
+    // looking down, front is up and left is left
+    const auto v = HRTFDatabase::toUnitVector (azimuthDeg, elevationDeg);
+    const float radius = juce::jmin (topArea.getWidth(), topArea.getHeight()) * 0.5f - dotSize;
+    return topArea.getCentre() + juce::Point<float> (-v.y, -v.x) * radius;
+}
+
+juce::Point<float> SphereView::sidePoint (float azimuthDeg, float elevationDeg) const
+{
+    // seen from the left, front is to the right and up is up
+    const auto v = HRTFDatabase::toUnitVector (azimuthDeg, elevationDeg);
+    const float radius = juce::jmin (sideArea.getWidth(), sideArea.getHeight()) * 0.5f - dotSize;
+    return sideArea.getCentre() + juce::Point<float> (v.x, -v.z) * radius;
+}
+
+juce::Rectangle<int> SphereView::dotArea (juce::Point<float> centre) const
+{
+    return juce::Rectangle<float> (dotSize + 4.0f, dotSize + 4.0f).withCentre (centre).getSmallestIntegerContainer();
+}
+
+void SphereView::renderStaticLayer()
+{
+    staticLayerDirty = false;
+
+    if (getWidth() <= 0 || getHeight() <= 0)
+        return;
+
+    const float scale = juce::Component::getApproximateScaleFactorForComponent (this);
+    staticLayer = juce::Image (juce::Image::RGB, juce::roundToInt (getWidth() * scale), juce::roundToInt (getHeight() * scale), true);
+
+    juce::Graphics g (staticLayer);
+    g.addTransform (juce::AffineTransform::scale (scale));
+    g.fillAll (background);
+
+    for (auto area : { topArea, sideArea })
+    {
+        const float radius = juce::jmin (area.getWidth(), area.getHeight()) * 0.5f - dotSize;
+        auto circle = juce::Rectangle<float> (radius * 2.0f, radius * 2.0f).withCentre (area.getCentre());
+
+        g.setColour (juce::Colours::dodgerblue);
+        g.drawEllipse (circle.translated (1.5f, 1.5f), 3.0f);
+        g.setColour (juce::Colours::hotpink);
+        g.drawEllipse (circle, 3.0f);
+
+        // the head, nose towards the front
+        g.setColour (juce::Colours::hotpink.withAlpha (0.6f));
+        g.fillEllipse (juce::Rectangle<float> (12.0f, 12.0f).withCentre (area.getCentre()));
+    }
+
+    g.drawLine (juce::Line<float> (topArea.getCentre(), topArea.getCentre().translated (0.0f, -14.0f)), 2.0f);
+    g.drawLine (juce::Line<float> (sideArea.getCentre(), sideArea.getCentre().translated (14.0f, 0.0f)), 2.0f);
+
+    // one pixel per measurement, batched into a single fill
+    if (drawnDatabase != nullptr)
+    {
+        juce::RectangleList<float> points;
+        for (int i = 0; i < drawnDatabase->getNumIRs(); ++i)
+        {
+            const float azi = drawnDatabase->getAzimuth (i), ele = drawnDatabase->getElevation (i);
+            points.addWithoutMerging (juce::Rectangle<float> (1.5f, 1.5f).withCentre (topPoint (azi, ele)));
+            points.addWithoutMerging (juce::Rectangle<float> (1.5f, 1.5f).withCentre (sidePoint (azi, ele)));
+        }
+
+        g.setColour (juce::Colours::dodgerblue.withAlpha (0.35f));
+        g.fillRectList (points);
+    }
+}
+
+void SphereView::paint (juce::Graphics& g)
+{
+    if (staticLayerDirty)
+        renderStaticLayer();
+
+    g.drawImage (staticLayer, getLocalBounds().toFloat());
+
+    auto drawDot = [&g] (juce::Point<float> centre, juce::Colour colour)
+    {
+        auto dot = juce::Rectangle<float> (dotSize, dotSize).withCentre (centre);
+        g.setColour (juce::Colours::dodgerblue);
+        g.fillEllipse (dot.translated (1.5f, 1.5f));
+        g.setColour (colour);
+        g.fillEllipse (dot);
+    };
+
+    // right source first, so the left one is on top when they coincide (width 0)
+    drawDot (topPoint (shown[2], shown[3]), juce::Colours::white);
+    drawDot (sidePoint (shown[2], shown[3]), juce::Colours::white);
+    drawDot (topPoint (shown[0], shown[1]), juce::Colours::hotpink);
+    drawDot (sidePoint (shown[0], shown[1]), juce::Colours::hotpink);
+}
+
+void SphereView::timerCallback()
+{
+    auto database = audioProcessor.getDatabase();
+    if (database != drawnDatabase)
+    {
+        drawnDatabase = std::move (database);
+        staticLayerDirty = true;
+        repaint();
+
+        // restores load in the background, the editor's status line is out of date too
+        if (auto* parent = getParentComponent())
+            parent->repaint();
+    }
+
+    const auto positions = audioProcessor.getRenderedPositions();
+    std::array<float, 4> latest { positions.aziL, positions.eleL, positions.aziR, positions.eleR };
+
+    if (latest == shown)
+        return;
+
+    // only the old and new spots of the dots
+    for (auto* angles : { &shown, &latest })
+    {
+        for (int source = 0; source < 2; ++source)
+        {
+            const float azi = (*angles)[(size_t) source * 2], ele = (*angles)[(size_t) source * 2 + 1];
+            repaint (dotArea (topPoint (azi, ele)));
+            repaint (dotArea (sidePoint (azi, ele)));
+        }
+    }
+
+    shown = latest;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <JuceHeader.h>
+
+class NewProjectAudioProcessor;
+class HRTFDatabase;
+
+// Top-down and side view of where the two sources are rendered (after head tracking),
+// over the measurement points of the loaded set.
+// The grid and the measurement points are drawn once into an image and only redrawn when
+// the size or the database changes. The sources are polled from the processor's atomic
+// snapshot at a capped rate, and only the areas around dots that moved are repainted.
+class SphereView  : public juce::Component,
+                    private juce::Timer
+{
+public:
+    static constexpr int frameRateHz = 30;
+
+    explicit SphereView (NewProjectAudioProcessor& p);
+    ~SphereView() override;
+
+    void paint (juce::Graphics&) override;
+    void resized() override;
+
+private:
+    void timerCallback() override;
+    void renderStaticLayer();
+
+    // where a direction lands in each view
+    juce::Point<float> topPoint (float azimuthDeg, float elevationDeg) const;
+    juce::Point<float> sidePoint (float azimuthDeg, float elevationDeg) const;
+    juce::Rectangle<int> dotArea (juce::Point<float> centre) const;
+
+    NewProjectAudioProcessor& audioProcessor;
+
+    juce::Image staticLayer;
+    std::shared_ptr<const HRTFDatabase> drawnDatabase;
+    bool staticLayerDirty = true;
+
+    juce::Rectangle<float> topArea, sideArea;
+
+    // last drawn source directions: azimuth / elevation of the left source, then the right one
+    std::array<float, 4> shown { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    static constexpr float dotSize = 10.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SphereView)
+};
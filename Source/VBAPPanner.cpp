@@ -0,0 +1,265 @@
+#include "VBAPPanner.h"
+#include "HRTFDatabase.h"
+#include "VirtualSpeakerRenderer.h"
+
+namespace {
+    constexpr size_t alignment = 64;
+
+    using Vec = juce::dsp::SIMDRegister<float>;
+    using Vector = juce::Vector3D<float>;
+
+    static inline float dot (const Vector& a, const Vector& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    static inline Vector cross (const Vector& a, const Vector& b) {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    static bool isLFE (juce::AudioChannelSet::ChannelType type) {
+        return type == juce::AudioChannelSet::LFE || type == juce::AudioChannelSet::LFE2;
+    }
+}
+
+bool VBAPPanner::isSupportedLayout (const juce::AudioChannelSet& layout)
+{
+    const int n = layout.size();
+    if (n <= 2 || n > maxOutputs)
+        return false;
+
+    if (layout.isDiscreteLayout())
+        return true;
+
+    int numDirectional = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        const auto type = layout.getTypeOfChannel (i);
+        float azi, ele;
+
+        if (VirtualSpeakerRenderer::getSpeakerDirection (type, azi, ele))
+            ++numDirectional;
+        else if (!isLFE (type))
+            return false;
+    }
+
+    return numDirectional >= 3;
+}
+
+void VBAPPanner::prepare (const juce::AudioChannelSet& layout, int maxBlockSize)
+{
+    numOutputs = juce::jmin (layout.size(), maxOutputs);
+    blockSize = maxBlockSize;
+
+    std::vector<Vector> directions;
+    std::vector<int> channels;
+
+    for (int i = 0; i < numOutputs; ++i)
+    {
+        float azi = 360.0f * (float) i / (float) numOutputs, ele = 0.0f;
+
+        if (!layout.isDiscreteLayout() && !VirtualSpeakerRenderer::getSpeakerDirection (layout.getTypeOfChannel (i), azi, ele))
+            continue;
+
+        directions.push_back (HRTFDatabase::toUnitVector (azi, ele));
+        channels.push_back (i);
+    }
+
+    triangulate (directions, channels);
+
+    // the two input frames, the mix and the ramp, each starting on a cache line
+    constexpr int floatsPerLine = (int) (alignment / sizeof (float));
+    rowStride = (blockSize + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+    storage.assign ((size_t) ((maxSources + 2) * rowStride + floatsPerLine), 0.0f);
+
+    auto* p = reinterpret_cast<float*> ((reinterpret_cast<uintptr_t> (storage.data()) + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    inputs = p;
+    mix = p + maxSources * rowStride;
+    ramp = mix + rowStride;
+    rampLength = 0;
+
+    reset();
+}
+
+void VBAPPanner::reset()
+{
+    for (auto& row : currentGains)
+        row.fill (0.0f);
+    for (auto& row : targetGains)
+        row.fill (0.0f);
+}
+
+void VBAPPanner::triangulate (const std::vector<Vector>& directions, const std::vector<int>& channels)
+{
+    triangles.clear();
+
+    auto points = directions;
+    auto owners = channels;
+
+    // no speaker high up / low down: close the hull with an imaginary one there, so a flat ring
+    // (or a ring plus a top layer) still pans across its edge pairs
+    float minZ = 1.0f, maxZ = -1.0f;
+    for (auto& d : directions)
+    {
+        minZ = juce::jmin (minZ, d.z);
+        maxZ = juce::jmax (maxZ, d.z);
+    }
+
+    if (maxZ < 0.2f) { points.push_back ({ 0.0f, 0.0f, 1.0f });  owners.push_back (-1); }
+    if (minZ > -0.2f) { points.push_back ({ 0.0f, 0.0f, -1.0f }); owners.push_back (-1); }
+
+    const int n = (int) points.size();
+    constexpr float eps = 1.0e-4f;
+
+    // brute force hull: a triangle is a face when every other point is on one side of its plane.
+    // At most 66 points, and it only runs when the layout changes
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = i + 1; j < n; ++j)
+        {
+            for (int k = j + 1; k < n; ++k)
+            {
+                const auto normal = cross (points[(size_t) j] - points[(size_t) i], points[(size_t) k] - points[(size_t) i]);
+                if (dot (normal, normal) < eps * eps)
+                    continue;
+
+                const float offset = dot (normal, points[(size_t) i]);
+                bool above = false, below = false;
+
+                for (int m = 0; m < n && !(above && below); ++m)
+                {
+                    const float side = dot (normal, points[(size_t) m]) - offset;
+                    above = above || side > eps;
+                    below = below || side < -eps;
+                }
+
+                if (above && below)
+                    continue;
+
+                // columns a, b, c -> inverse through the adjugate
+                const auto& a = points[(size_t) i];
+                const auto& b = points[(size_t) j];
+                const auto& c = points[(size_t) k];
+
+                const float det = dot (a, cross (b, c));
+                if (std::abs (det) < eps)
+                    continue;
+
+                const auto r0 = cross (b, c), r1 = cross (c, a), r2 = cross (a, b);
+
+                Triangle t;
+                t.speakers = { owners[(size_t) i], owners[(size_t) j], owners[(size_t) k] };
+                t.inverse[0][0] = r0.x / det; t.inverse[0][1] = r0.y / det; t.inverse[0][2] = r0.z / det;
+                t.inverse[1][0] = r1.x / det; t.inverse[1][1] = r1.y / det; t.inverse[1][2] = r1.z / det;
+                t.inverse[2][0] = r2.x / det; t.inverse[2][1] = r2.y / det; t.inverse[2][2] = r2.z / det;
+                triangles.push_back (t);
+            }
+        }
+    }
+
+    DBG("VBAP: " + juce::String ((int) directions.size()) + " speakers, " + juce::String ((int) triangles.size()) + " triangles");
+}
+
+void VBAPPanner::setDirection (int source, float azimuthDeg, float elevationDeg, float gain)
+{
+    auto& gains = targetGains[(size_t) source];
+    gains.fill (0.0f);
+
+    const auto p = HRTFDatabase::toUnitVector (azimuthDeg, elevationDeg);
+
+    // the triangle the direction falls in has no negative gain; outside the array's coverage
+    // take the one it's closest to falling in
+    const Triangle* best = nullptr;
+    float bestWorst = -1.0e9f;
+    float g[3] = {};
+
+    for (auto& t : triangles)
+    {
+        float candidate[3];
+        for (int r = 0; r < 3; ++r)
+            candidate[r] = t.inverse[r][0] * p.x + t.inverse[r][1] * p.y + t.inverse[r][2] * p.z;
+
+        const float worst = juce::jmin (candidate[0], candidate[1], candidate[2]);
+        if (worst > bestWorst)
+        {
+            bestWorst = worst;
+            best = &t;
+            std::copy (candidate, candidate + 3, g);
+
+            if (worst >= -1.0e-5f)
+                break;
+        }
+    }
+
+    if (best == nullptr)
+        return;
+
+    // imaginary speakers' share is dropped, the rest is normalised to constant power
+    float power = 0.0f;
+    for (int v = 0; v < 3; ++v)
+    {
+        if (best->speakers[(size_t) v] < 0)
+            continue;
+
+        const float value = juce::jmax (0.0f, g[v]);
+        gains[(size_t) best->speakers[(size_t) v]] = value;
+        power += value * value;
+    }
+
+    if (power > 0.0f)
+        for (auto& value : gains)
+            value *= gain / std::sqrt (power);
+}
+
+void VBAPPanner::process (const float* const* sources, float* const* outputs, int numSamples)
+{
+    jassert (numSamples <= blockSize);
+
+    for (int s = 0; s < maxSources; ++s)
+        std::copy (sources[s], sources[s] + numSamples, inputs + s * rowStride);
+
+    if (rampLength != numSamples)
+    {
+        for (int n = 0; n < numSamples; ++n)
+            ramp[n] = (float) (n + 1) / (float) numSamples;
+        rampLength = numSamples;
+    }
+
+    const int vectorEnd = numSamples / (int) Vec::size() * (int) Vec::size();
+
+    for (int o = 0; o < numOutputs; ++o)
+    {
+        bool reached = false;
+        for (int s = 0; s < maxSources; ++s)
+            reached = reached || currentGains[(size_t) s][(size_t) o] != 0.0f || targetGains[(size_t) s][(size_t) o] != 0.0f;
+
+        // VBAP feeds at most three speakers per source, the rest are simply silent
+        if (!reached)
+        {
+            juce::FloatVectorOperations::clear (outputs[o], numSamples);
+            continue;
+        }
+
+        std::fill (mix, mix + numSamples, 0.0f);
+
+        for (int s = 0; s < maxSources; ++s)
+        {
+            const float start = currentGains[(size_t) s][(size_t) o];
+            const float delta = targetGains[(size_t) s][(size_t) o] - start;
+            if (start == 0.0f && delta == 0.0f)
+                continue;
+
+            const float* in = inputs + s * rowStride;
+            const auto startVec = Vec::expand (start), deltaVec = Vec::expand (delta);
+
+            for (int n = 0; n < vectorEnd; n += (int) Vec::size())
+                (Vec::fromRawArray (mix + n) + Vec::fromRawArray (in + n) * (startVec + deltaVec * Vec::fromRawArray (ramp + n))).copyToRawArray (mix + n);
+
+            for (int n = vectorEnd; n < numSamples; ++n)
+                mix[n] += in[n] * (start + delta * ramp[n]);
+        }
+
+        juce::FloatVectorOperations::copy (outputs[o], mix, numSamples);
+    }
+
+    currentGains = targetGains;
+}
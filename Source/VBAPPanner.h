@@ -0,0 +1,58 @@
+#pragma once
+#include <JuceHeader.h>
+#include "MemoryLock.h"
+
+// Loudspeaker-array output: vector base amplitude panning (Pulkki) of the two sources onto the
+// speakers of the output layout, for rooms with real speakers instead of headphones.
+// The layout is triangulated once in prepare() (convex hull of the speaker directions, with an
+// imaginary speaker straight above / below when the array has none there, whose share is dropped).
+// Gains are found per control block; the audio itself is one ramped gain matrix, run on SIMD
+// registers and only over the outputs a source actually reaches.
+// Named layouts use the standard speaker positions; discrete layouts are taken as an even
+// horizontal ring, channel 1 straight ahead and counting to the left.
+class VBAPPanner
+{
+public:
+    static constexpr int maxOutputs = 64;
+    static constexpr int maxSources = 2;
+
+    // More than two channels, at most maxOutputs, and either discrete or every channel with a
+    // standard direction / LFE (LFEs get nothing).
+    static bool isSupportedLayout (const juce::AudioChannelSet& layout);
+
+    void prepare (const juce::AudioChannelSet& layout, int maxBlockSize);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const { set.add (storage.data(), storage.size() * sizeof (float)); }
+
+    int getNumOutputs() const noexcept { return numOutputs; }
+
+    // control rate: where a source should be by the end of the next process() call
+    void setDirection (int source, float azimuthDeg, float elevationDeg, float gain);
+
+    // Overwrites all outputs, ramping every gain from the last call's target to the new one.
+    void process (const float* const* sources, float* const* outputs, int numSamples);
+
+private:
+    struct Triangle
+    {
+        std::array<int, 3> speakers;   // output channel, or -1 for an imaginary speaker
+        float inverse[3][3];           // of the matrix with the three directions as columns
+    };
+
+    void triangulate (const std::vector<juce::Vector3D<float>>& directions, const std::vector<int>& channels);
+
+    int numOutputs = 0, blockSize = 0;
+    std::vector<Triangle> triangles;
+
+    using GainRow = std::array<float, maxOutputs>;
+    std::array<GainRow, maxSources> currentGains {}, targetGains {};
+
+    std::vector<float> storage;
+    int rowStride = 0;
+    float* inputs = nullptr;   // [maxSources][rowStride]
+    float* mix = nullptr;
+    float* ramp = nullptr;     // (n + 1) / numSamples
+    int rampLength = 0;
+};
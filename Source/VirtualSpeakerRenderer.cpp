@@ -0,0 +1,276 @@
+#include "VirtualSpeakerRenderer.h"
+
+namespace {
+    constexpr size_t alignment = 64;
+
+    // the level of a kernel normalised by transformKernel, for white noise
+    constexpr float lfeGain = 0.125f;
+}
+
+bool VirtualSpeakerRenderer::getSpeakerDirection (juce::AudioChannelSet::ChannelType type, float& azimuthDeg, float& elevationDeg) noexcept
+{
+    using CT = juce::AudioChannelSet::ChannelType;
+
+    // azimuth 0 = front, 90 = left
+    auto set = [&] (float azi, float ele) { azimuthDeg = azi < 0.0f ? azi + 360.0f : azi; elevationDeg = ele; return true; };
+
+    switch (type)
+    {
+        case CT::left:              return set (30.0f, 0.0f);
+        case CT::right:             return set (-30.0f, 0.0f);
+        case CT::centre:            return set (0.0f, 0.0f);
+        case CT::leftCentre:        return set (15.0f, 0.0f);
+        case CT::rightCentre:       return set (-15.0f, 0.0f);
+        case CT::wideLeft:          return set (60.0f, 0.0f);
+        case CT::wideRight:         return set (-60.0f, 0.0f);
+        case CT::leftSurroundSide:  return set (90.0f, 0.0f);
+        case CT::rightSurroundSide: return set (-90.0f, 0.0f);
+        case CT::leftSurround:      return set (110.0f, 0.0f);
+        case CT::rightSurround:     return set (-110.0f, 0.0f);
+        case CT::leftSurroundRear:  return set (150.0f, 0.0f);
+        case CT::rightSurroundRear: return set (-150.0f, 0.0f);
+        case CT::centreSurround:    return set (180.0f, 0.0f);
+        case CT::topFrontLeft:      return set (45.0f, 45.0f);
+        case CT::topFrontRight:     return set (-45.0f, 45.0f);
+        case CT::topFrontCentre:    return set (0.0f, 45.0f);
+        case CT::topSideLeft:       return set (90.0f, 45.0f);
+        case CT::topSideRight:      return set (-90.0f, 45.0f);
+        case CT::topRearLeft:       return set (135.0f, 45.0f);
+        case CT::topRearRight:      return set (-135.0f, 45.0f);
+        case CT::topRearCentre:     return set (180.0f, 45.0f);
+        case CT::topMiddle:         return set (0.0f, 90.0f);
+        default:                    return false;
+    }
+}
+
+bool VirtualSpeakerRenderer::isSupportedLayout (const juce::AudioChannelSet& layout)
+{
+    const int n = layout.size();
+    if (n <= 2 || n > maxChannels)
+        return false;
+
+    for (int i = 0; i < n; ++i)
+    {
+        const auto type = layout.getTypeOfChannel (i);
+        float azi, ele;
+        if (type != juce::AudioChannelSet::LFE && type != juce::AudioChannelSet::LFE2 && !getSpeakerDirection (type, azi, ele))
+            return false;
+    }
+
+    return true;
+}
+
+void VirtualSpeakerRenderer::prepare (const juce::AudioChannelSet& layout, int newBlockSize)
+{
+    blockSize = newBlockSize;
+    fftSize = 2 * blockSize;
+    binStride = PartitionedConvolver::Transform::getBinStride (blockSize);
+    maxPartitions = (maxKernelLength + blockSize - 1) / blockSize;
+
+    speakers.assign ((size_t) juce::jmin (layout.size(), maxChannels), {});
+
+    const size_t spectrumFloats = 2 * (size_t) binStride;
+    const size_t kernelSetFloats = 2 * (size_t) maxPartitions * spectrumFloats;
+    const size_t speakerFloats = (size_t) maxPartitions * spectrumFloats + (size_t) fftSize + 2 * kernelSetFloats;
+    const size_t total = speakers.size() * speakerFloats + 2 * (size_t) fftSize + spectrumFloats + (size_t) HRTFDatabase::fetchScratchSize
+                       + 2 * (size_t) blockSize;
+
+    storage.assign (total + alignment / sizeof (float), 0.0f);
+
+    auto* p = reinterpret_cast<float*> ((reinterpret_cast<uintptr_t> (storage.data()) + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    auto carve = [&p] (size_t numFloats) { auto* start = p; p += numFloats; return start; };
+
+    for (size_t i = 0; i < speakers.size(); ++i)
+    {
+        auto& s = speakers[i];
+        const auto type = layout.getTypeOfChannel ((int) i);
+        s.isLFE = !getSpeakerDirection (type, s.azimuth, s.elevation);
+
+        s.fdl = carve ((size_t) maxPartitions * spectrumFloats);
+        s.frame = carve ((size_t) fftSize);
+        s.current.data = carve (kernelSetFloats);
+        s.previous.data = carve (kernelSetFloats);
+    }
+
+    fftBuffer = carve (2 * (size_t) fftSize);
+    acc = carve (spectrumFloats);
+    irScratch = carve ((size_t) HRTFDatabase::fetchScratchSize);
+    earScratch = carve (2 * (size_t) blockSize);
+    transform.prepare (blockSize, fftBuffer);
+
+    jassert ((int) speakers.size() <= BasisRenderer::maxSources);
+    basis.prepare (blockSize);
+
+    reset();
+}
+
+void VirtualSpeakerRenderer::reset()
+{
+    for (auto& s : speakers)
+    {
+        std::fill (s.fdl, s.fdl + (size_t) maxPartitions * 2 * (size_t) binStride, 0.0f);
+        std::fill (s.frame, s.frame + fftSize, 0.0f);
+
+        // fade the next kernels in from silence, ids are only meaningful for one database
+        s.current.numPartitions = s.previous.numPartitions = 0;
+        s.current.id = s.previous.id = -1;
+        s.changed = false;
+        s.basisIndex = -1;
+    }
+
+    basis.reset();
+    fdlHead = 0;
+}
+
+void VirtualSpeakerRenderer::invalidateKernels() noexcept
+{
+    for (auto& s : speakers)
+        s.current.id = s.previous.id = -1;
+}
+
+void VirtualSpeakerRenderer::transformKernel (KernelSet& set, int id, const float* left, const float* right, int length)
+{
+    // same partitions and level as PartitionedConvolver, so the speakers sit at the level of a single source
+    set.numPartitions = transform.transformKernel (left, right, length, maxPartitions, set.data);
+    set.id = id;
+}
+
+void VirtualSpeakerRenderer::update (const HRTFDatabase& db, const HeadRotation& rotation)
+{
+    for (auto& s : speakers)
+    {
+        if (s.isLFE)
+            continue;
+
+        float azi = s.azimuth, ele = s.elevation;
+        rotation.apply (azi, ele);
+
+        const int id = db.findNearest (azi, ele);
+
+        // the basis path only needs the direction, the weights ramp by themselves
+        if (basis.isActive())
+        {
+            s.basisIndex = id;
+            continue;
+        }
+
+        if (id < 0 || id == s.current.id)
+            continue;
+
+        // a second change before the block ran keeps fading from what was actually playing
+        if (!s.changed)
+        {
+            std::swap (s.previous, s.current);
+            s.changed = true;
+        }
+
+        const auto ir = db.fetchIR (id, irScratch);
+        transformKernel (s.current, id, ir.left, ir.right, db.getIRLength());
+    }
+}
+
+void VirtualSpeakerRenderer::accumulate (int ear, bool fadingOut)
+{
+    std::fill (acc, acc + 2 * binStride, 0.0f);
+
+    for (auto& s : speakers)
+    {
+        if (s.isLFE)
+            continue;
+
+        const auto& set = (fadingOut && s.changed) ? s.previous : s.current;
+
+        for (int p = 0; p < set.numPartitions; ++p)
+            PartitionedConvolver::complexMultiplyAccumulate (delayLineSlot (s, fdlHead - p), kernelSpectrum (set, ear, p), acc, binStride);
+    }
+}
+
+void VirtualSpeakerRenderer::setBasis (const HRTFDatabase& db)
+{
+    const bool wasActive = basis.isActive();
+    basis.setBasis (db);
+
+    // switching between kernels and basis: nothing of the other mode is worth a crossfade
+    if (wasActive || basis.isActive())
+        reset();
+}
+
+void VirtualSpeakerRenderer::process (const HRTFDatabase& db, const float* const* channels, float* outL, float* outR)
+{
+    if (basis.isActive())
+    {
+        float* earL = earScratch;
+        float* earR = earScratch + blockSize;
+
+        for (size_t i = 0; i < speakers.size(); ++i)
+        {
+            const auto& s = speakers[i];
+            if (s.isLFE)
+                continue;
+
+            basis.delaySource (db, (int) i, channels[i], earL, earR, blockSize, s.basisIndex);
+            basis.mixSource (db, (int) i, earL, earR, 0, blockSize, s.basisIndex);
+        }
+
+        basis.process (outL, outR);
+        addLFE (channels, outL, outR);
+        return;
+    }
+
+    fdlHead = (fdlHead + 1) % maxPartitions;
+    bool fading = false;
+
+    // every channel is transformed once, whatever number of ears and partitions it feeds
+    for (size_t i = 0; i < speakers.size(); ++i)
+    {
+        auto& s = speakers[i];
+        if (s.isLFE)
+            continue;
+
+        std::copy (s.frame + blockSize, s.frame + fftSize, s.frame);
+        std::copy (channels[i], channels[i] + blockSize, s.frame + blockSize);
+        transform.forward (s.frame, fftSize, delayLineSlot (s, fdlHead));
+
+        fading = fading || s.changed;
+    }
+
+    float* outs[2] = { outL, outR };
+
+    for (int ear = 0; ear < 2; ++ear)
+    {
+        auto* out = outs[ear];
+
+        accumulate (ear, false);
+        transform.inverse (acc, out, 0, blockSize);
+
+        if (fading)
+        {
+            // the speakers that changed, on their old kernels; fftBuffer is free again after the copy out
+            accumulate (ear, true);
+            transform.inverse (acc, fftBuffer, 0, blockSize);
+
+            for (int n = 0; n < blockSize; ++n)
+            {
+                const float t = ((float) n + 0.5f) / (float) blockSize;
+                out[n] = fftBuffer[n] + t * (out[n] - fftBuffer[n]);
+            }
+        }
+    }
+
+    for (auto& s : speakers)
+        s.changed = false;
+
+    addLFE (channels, outL, outR);
+}
+
+void VirtualSpeakerRenderer::addLFE (const float* const* channels, float* outL, float* outR)
+{
+    for (size_t i = 0; i < speakers.size(); ++i)
+    {
+        if (speakers[i].isLFE)
+        {
+            juce::FloatVectorOperations::addWithMultiply (outL, channels[i], lfeGain, blockSize);
+            juce::FloatVectorOperations::addWithMultiply (outR, channels[i], lfeGain, blockSize);
+        }
+    }
+}
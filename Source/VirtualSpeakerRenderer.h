@@ -0,0 +1,92 @@
+#pragma once
+#include <JuceHeader.h>
+#include "HRTFDatabase.h"
+#include "HeadTracker.h"
+#include "BasisRenderer.h"
+#include "PartitionedConvolver.h"
+
+// Headphone monitoring of surround / immersive beds (5.1, 7.1, 7.1.4, ...): every input channel is a
+// virtual loudspeaker at its standard position, rendered through the loaded HRIR set.
+// One frequency-domain engine for all of them: each channel is transformed once into its own delay
+// line, every speaker's share of both ears is summed in the spectral domain, and only the two ear
+// signals go back through an inverse FFT, however many speakers there are.
+// Works on whole blocks of the size it was prepared with (overlap-save, no added latency).
+// With a set that has a basis the speakers are sources of a BasisRenderer instead: no kernels at all,
+// K + 1 convolutions per ear however many speakers there are.
+// LFE channels have no direction and go to both ears unfiltered.
+class VirtualSpeakerRenderer
+{
+public:
+    static constexpr int maxChannels = 16;          // 9.1.6
+    static constexpr int maxKernelLength = 1024;    // longer IRs are truncated (SADIE goes up to 512)
+
+    // Standard direction of a speaker channel (ITU-R BS.775 / BS.2051), false for LFE and unknown channels.
+    static bool getSpeakerDirection (juce::AudioChannelSet::ChannelType type, float& azimuthDeg, float& elevationDeg) noexcept;
+
+    // More than two channels, and every one of them either has a direction or is an LFE.
+    static bool isSupportedLayout (const juce::AudioChannelSet& layout);
+
+    void prepare (const juce::AudioChannelSet& layout, int blockSize);
+    void reset();
+
+    // prefaults and locks what prepare() allocated (see MemoryLock)
+    void lockInMemory (MemoryLock::Set& set) const { set.add (storage.data(), storage.size() * sizeof (float)); basis.lockInMemory (set); }
+
+    int getNumChannels() const noexcept { return (int) speakers.size(); }
+
+    // Picks the kernels for the head-relative speaker directions, changes are crossfaded over the next block.
+    void update (const HRTFDatabase& db, const HeadRotation& rotation);
+
+    // Another database from here on: the next update() picks every kernel afresh and crossfades
+    // into it, the input history is kept.
+    void invalidateKernels() noexcept;
+
+    // Renders through db's basis from here on if it has one (see BasisRenderer::setBasis), with kernels otherwise.
+    // Call whenever the database changes.
+    void setBasis (const HRTFDatabase& db);
+
+    // One block: a pointer per input channel in, both ears out (overwritten). db is the one update() saw.
+    void process (const HRTFDatabase& db, const float* const* channels, float* outL, float* outR);
+
+private:
+    // spectra of one kernel pair, [ear][partition] -> re then im, binStride floats each
+    struct KernelSet
+    {
+        float* data = nullptr;
+        int numPartitions = 0;
+        int id = -1;
+    };
+
+    struct Speaker
+    {
+        float azimuth = 0.0f, elevation = 0.0f;
+        bool isLFE = false;
+
+        float* fdl = nullptr;    // maxPartitions input spectra
+        float* frame = nullptr;  // previous block, then the current one
+        KernelSet current, previous;
+        bool changed = false;    // previous still has to be faded out
+        int basisIndex = -1;     // the direction on the basis path
+    };
+
+    float* spectrum (float* base, int index) const noexcept { return base + (size_t) index * 2 * (size_t) binStride; }
+    float* kernelSpectrum (const KernelSet& set, int ear, int partition) const noexcept { return spectrum (set.data, ear * maxPartitions + partition); }
+    float* delayLineSlot (const Speaker& s, int index) const noexcept { return spectrum (s.fdl, (index + maxPartitions) % maxPartitions); }
+
+    void transformKernel (KernelSet& set, int id, const float* left, const float* right, int length);
+    void accumulate (int ear, bool fadingOut);
+    void addLFE (const float* const* channels, float* outL, float* outR);
+
+    int blockSize = 0, fftSize = 0, binStride = 0, maxPartitions = 0;
+    PartitionedConvolver::Transform transform; // the convolver's partitions, FFTs and kernel level
+
+    std::vector<Speaker> speakers;
+    std::vector<float> storage;
+    float* fftBuffer = nullptr;
+    float* acc = nullptr;
+    float* irScratch = nullptr; // widened HRIRs of 16-bit sets
+    float* earScratch = nullptr; // one speaker's delayed ear signals, basis path
+
+    BasisRenderer basis;
+    int fdlHead = 0;
+};
@@ -0,0 +1,95 @@
+// Test runner only: every heap allocation and release of the process goes through here and is a
+// violation inside an audio callback (see RealtimeSafety.h). Only the calling thread's flag is looked
+// at, so outside a callback this is plain malloc / free.
+#include "../../Source/RealtimeSafety.h"
+#include <new>
+#include <cstdlib>
+
+#if ! ANNIE_REALTIME_CHECKS
+ #error "The test runner needs ANNIE_REALTIME_CHECKS=1"
+#endif
+
+// the C library calls hooked in SystemCallHooks.c report through here
+extern "C" void annieRealtimeViolation (const char* what)
+{
+    RealtimeSafetyChecker::assertNotAudioThread (what);
+}
+
+namespace {
+    static void* allocate (std::size_t size) noexcept {
+        RealtimeSafetyChecker::assertNotAudioThread ("heap allocation");
+        return std::malloc (size > 0 ? size : 1);
+    }
+
+    static void* allocateAligned (std::size_t size, std::align_val_t alignment) noexcept {
+        RealtimeSafetyChecker::assertNotAudioThread ("heap allocation");
+        const auto align = juce::jmax ((std::size_t) alignment, sizeof (void*));
+
+       #if JUCE_WINDOWS
+        return _aligned_malloc (size > 0 ? size : 1, align);
+       #else
+        void* p = nullptr;
+        return posix_memalign (&p, align, size > 0 ? size : 1) == 0 ? p : nullptr;
+       #endif
+    }
+
+    static void release (void* p) noexcept {
+        if (p != nullptr)
+            RealtimeSafetyChecker::assertNotAudioThread ("heap release");
+        std::free (p);
+    }
+
+    static void releaseAligned (void* p) noexcept {
+        if (p != nullptr)
+            RealtimeSafetyChecker::assertNotAudioThread ("heap release");
+
+       #if JUCE_WINDOWS
+        _aligned_free (p);
+       #else
+        std::free (p);
+       #endif
+    }
+}
+
+void* operator new (std::size_t size)
+{
+    if (auto* p = allocate (size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)
+{
+    if (auto* p = allocate (size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    if (auto* p = allocateAligned (size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment)
+{
+    if (auto* p = allocateAligned (size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new   (std::size_t size, const std::nothrow_t&) noexcept { return allocate (size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept { return allocate (size); }
+
+void operator delete   (void* p) noexcept                { release (p); }
+void operator delete[] (void* p) noexcept                { release (p); }
+void operator delete   (void* p, std::size_t) noexcept   { release (p); }
+void operator delete[] (void* p, std::size_t) noexcept   { release (p); }
+void operator delete   (void* p, const std::nothrow_t&) noexcept { release (p); }
+void operator delete[] (void* p, const std::nothrow_t&) noexcept { release (p); }
+
+void operator delete   (void* p, std::align_val_t) noexcept              { releaseAligned (p); }
+void operator delete[] (void* p, std::align_val_t) noexcept              { releaseAligned (p); }
+void operator delete   (void* p, std::size_t, std::align_val_t) noexcept { releaseAligned (p); }
+void operator delete[] (void* p, std::size_t, std::align_val_t) noexcept { releaseAligned (p); }
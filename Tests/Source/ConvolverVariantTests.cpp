@@ -0,0 +1,80 @@
+// PartitionedConvolver's inner loops compiled for fixed sizes against the generic ones (prepare with
+// specialisedLoops off): the same input and kernel changes through both, at every partition size that
+// has specialised loops and IR lengths that do (256 / 512 / 1024) and don't (300) get an unrolled tail.
+// Both have to agree to within float rounding.
+#include <JuceHeader.h>
+#include "../../Source/PartitionedConvolver.h"
+
+class ConvolverVariantTest : public juce::UnitTest
+{
+public:
+    ConvolverVariantTest() : juce::UnitTest ("Convolver inner loops", "PartitionedConvolver") {}
+
+    void runTest() override
+    {
+        for (int partitionSize = 32; partitionSize <= 512; partitionSize *= 2)
+        {
+            beginTest ("Partition size " + juce::String (partitionSize));
+
+            for (int irLength : { 256, 512, 1024, 300 })
+                compare (partitionSize, irLength);
+        }
+    }
+
+private:
+    void compare (int partitionSize, int irLength)
+    {
+        constexpr int numKernels = 6, numBlocks = 64;
+        juce::Random random (partitionSize * 10000 + irLength);
+
+        std::vector<std::vector<float>> kernels;
+        for (int k = 0; k < numKernels; ++k)
+        {
+            std::vector<float> pair (2 * (size_t) irLength);
+            for (size_t i = 0; i < pair.size(); ++i)
+                pair[i] = (random.nextFloat() * 2.0f - 1.0f) * std::exp (-4.0f * (float) (i % (size_t) irLength) / (float) irLength);
+
+            kernels.push_back (std::move (pair));
+        }
+
+        PartitionedConvolver specialised, generic;
+        specialised.prepare (partitionSize, true);
+        generic.prepare (partitionSize, false);
+
+        std::vector<float> input ((size_t) partitionSize), specialisedL ((size_t) partitionSize), specialisedR ((size_t) partitionSize),
+                           genericL ((size_t) partitionSize), genericR ((size_t) partitionSize);
+        float maxDifference = 0.0f, peak = 0.0f;
+
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            // a new kernel every third block, so crossfades, staged and fresh transforms all come up
+            if (b % 3 == 0)
+            {
+                const int id = (b / 3) % numKernels;
+                const auto& pair = kernels[(size_t) id];
+                specialised.setKernel (id, pair.data(), pair.data() + irLength, irLength);
+                generic.setKernel (id, pair.data(), pair.data() + irLength, irLength);
+            }
+
+            // odd call sizes as well as whole partitions
+            const int numSamples = b % 4 == 3 ? partitionSize / 2 + 1 : partitionSize;
+            for (int i = 0; i < numSamples; ++i)
+                input[(size_t) i] = random.nextFloat() * 2.0f - 1.0f;
+
+            specialised.process (input.data(), specialisedL.data(), specialisedR.data(), numSamples);
+            generic.process (input.data(), genericL.data(), genericR.data(), numSamples);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                maxDifference = juce::jmax (maxDifference, std::abs (specialisedL[(size_t) i] - genericL[(size_t) i]),
+                                            std::abs (specialisedR[(size_t) i] - genericR[(size_t) i]));
+                peak = juce::jmax (peak, std::abs (genericL[(size_t) i]), std::abs (genericR[(size_t) i]));
+            }
+        }
+
+        expect (peak > 0.0f, "No output");
+        expectLessOrEqual (maxDifference, peak * 1.0e-6f, juce::String (irLength) + " taps: specialised and generic loops disagree");
+    }
+};
+
+static ConvolverVariantTest convolverVariantTest;
@@ -0,0 +1,34 @@
+// Runs the plugin's tests and returns non-zero if any check failed:
+//     "Annie's 3D Panner Tests" [part of a test name ...]
+// No arguments runs them all. The bundled SADIE sets are looked for above the runner and the working
+// directory (see TestData.h), so run it from inside the repo.
+#include <JuceHeader.h>
+#include <iostream>
+
+int main (int argc, char* argv[])
+{
+    // the processor's timers and async updates need a message thread, this one
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::Array<juce::UnitTest*> tests;
+    for (auto* test : juce::UnitTest::getAllTests())
+    {
+        bool wanted = argc <= 1;
+        for (int i = 1; i < argc; ++i)
+            wanted = wanted || test->getName().containsIgnoreCase (argv[i]);
+
+        if (wanted)
+            tests.add (test);
+    }
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure (false);
+    runner.runTests (tests);
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult (i)->failures;
+
+    std::cout << (failures == 0 ? juce::String ("All tests passed.") : juce::String (failures) + " checks failed.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
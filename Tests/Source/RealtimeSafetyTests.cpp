@@ -0,0 +1,193 @@
+// The whole plugin on a stand-in audio thread, with the bundled SADIE sets loaded into all four subject
+// slots: parameters are automated between blocks of odd sizes while the message thread reloads, re-routes
+// and switches sets underneath it. Any heap allocation, lock, wait or blocking call inside processBlock or
+// getTailLengthSeconds (see AllocatorHooks.cpp, SystemCallHooks.c) fails the test, and so does any non-finite output.
+#include <JuceHeader.h>
+#include <mutex>
+#include "TestData.h"
+#include "../../Source/PluginProcessor.h"
+
+namespace
+{
+    constexpr int maxBlockSize = 1024;
+
+    void setParameter (NewProjectAudioProcessor& processor, const juce::String& id, float value)
+    {
+        auto* parameter = processor.getAPVTS().getParameter (id);
+        parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+    }
+
+    // what the tests do on the message thread runs between these, like the host's UI would
+    void pumpMessages (int milliseconds)
+    {
+        juce::MessageManager::getInstance()->runDispatchLoopUntil (milliseconds);
+    }
+
+    class HostThread : public juce::Thread
+    {
+    public:
+        HostThread (NewProjectAudioProcessor& p, int inputs, int outputs)
+            : juce::Thread ("Test audio thread"), processor (p), numInputs (inputs),
+              buffer (juce::jmax (inputs, outputs), maxBlockSize)
+        {
+        }
+
+        void run() override
+        {
+            static constexpr int blockSizes[] = { 1, 32, 64, 100, 128, 256, 441, 512, 1024 };
+            static const char* const automated[] = { "azimuth", "elevation", "width", "distance", "room", "roomSize",
+                                                     "propagationDelay", "subject" };
+            juce::Random random (numInputs);
+            juce::MidiBuffer midi;
+
+            while (!threadShouldExit())
+            {
+                const int numSamples = blockSizes[random.nextInt ((int) std::size (blockSizes))];
+                juce::AudioBuffer<float> block (buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+
+                block.clear();
+                for (int ch = 0; ch < numInputs; ++ch)
+                    for (int i = 0; i < numSamples; ++i)
+                        block.setSample (ch, i, random.nextFloat() - 0.5f);
+
+                // host automation arrives the way the wrappers deliver it, ahead of processBlock
+                if (random.nextInt (4) == 0)
+                {
+                    auto* parameter = processor.getAPVTS().getParameter (automated[random.nextInt ((int) std::size (automated))]);
+                    const float value = random.nextFloat();
+                    parameter->setValue (value);
+                    parameter->sendValueChangedMessageToListeners (value);
+                }
+
+                processor.processBlock (block, midi);
+
+                // hosts ask this from the audio thread too, so it's held to the same rules
+                {
+                    const RealtimeSafetyChecker::CallbackScope scope (tailChecker, 1.0);
+                    if (!std::isfinite (processor.getTailLengthSeconds()))
+                        ++badSamples;
+                }
+
+                for (int ch = 0; ch < block.getNumChannels(); ++ch)
+                    for (int i = 0; i < numSamples; ++i)
+                        if (!std::isfinite (block.getSample (ch, i)) || std::abs (block.getSample (ch, i)) > 16.0f)
+                            ++badSamples;
+
+                ++numBlocks;
+                juce::Thread::sleep (1);
+            }
+        }
+
+        std::atomic<int> numBlocks { 0 }, badSamples { 0 };
+
+    private:
+        NewProjectAudioProcessor& processor;
+        RealtimeSafetyChecker tailChecker;
+        const int numInputs;
+        juce::AudioBuffer<float> buffer;
+    };
+}
+
+class RealtimeSafetyTest : public juce::UnitTest
+{
+public:
+    RealtimeSafetyTest() : juce::UnitTest ("Realtime safety", "Plugin") {}
+
+    void runTest() override
+    {
+        // a hook that isn't linked in would pass everything below
+        beginTest ("The hooks catch allocations, locks and sleeps");
+        expectCaught ("A heap allocation", [] { juce::String s ("on the heap"); s << 12345; });
+        expectCaught ("A mutex", [] { std::mutex m; m.lock(); m.unlock(); });
+        expectCaught ("A sleep", [] { juce::Thread::sleep (1); });
+
+        const auto sadie = TestData::findSADIE();
+        beginTest ("The SADIE sets are there");
+        expect (sadie.isDirectory(), "No SADIE folder above the runner or the working directory");
+        if (!sadie.isDirectory())
+            return;
+
+        const auto stereo = juce::AudioChannelSet::stereo();
+        play (sadie, 48000.0, stereo, stereo);
+        play (sadie, 44100.0, juce::AudioChannelSet::mono(), stereo);
+        play (sadie, 96000.0, stereo, stereo);
+        play (sadie, 48000.0, juce::AudioChannelSet::create5point1(), stereo);
+        play (sadie, 48000.0, stereo, juce::AudioChannelSet::create5point1());
+    }
+
+private:
+    void expectCaught (const juce::String& what, const std::function<void()>& call)
+    {
+        RealtimeSafetyChecker checker;
+        const int before = RealtimeSafetyChecker::getNumViolations();
+        {
+            const RealtimeSafetyChecker::CallbackScope scope (checker, 1.0);
+            call();
+        }
+
+        expect (RealtimeSafetyChecker::getNumViolations() > before, what + " inside a callback went unnoticed");
+    }
+
+    void play (const juce::File& sadie, double sampleRate, const juce::AudioChannelSet& in, const juce::AudioChannelSet& out)
+    {
+        beginTest (juce::String (sampleRate / 1000.0, 1) + " kHz, " + in.getDescription() + " in, " + out.getDescription() + " out");
+
+        NewProjectAudioProcessor processor;
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add (in);
+        layout.outputBuses.add (out);
+        expect (processor.setBusesLayout (layout), "Layout refused");
+
+        processor.setRateAndBufferSizeDetails (sampleRate, maxBlockSize);
+        processor.prepareToPlay (sampleRate, maxBlockSize);
+
+        const auto folders = TestData::getSubjectFolders();
+        for (int subject = 0; subject < NewProjectAudioProcessor::numSubjects; ++subject)
+        {
+            setParameter (processor, "subject", (float) subject);
+            processor.setHRTFDirectory (sadie.getChildFile (folders[subject]));
+            expect (processor.getDatabase() != nullptr, "Couldn't load " + folders[subject]);
+        }
+
+        const int violationsBefore = RealtimeSafetyChecker::getNumViolations();
+        HostThread host (processor, in.size(), out.size());
+        host.startThread (juce::Thread::Priority::highest);
+
+        // automation alone first
+        pumpMessages (1000);
+
+        // everything that reloads the sets or re-routes the chain, on and then off again, under automation
+        const std::pair<const char*, float> settings[] = { { "diffuseFieldEQ", 1.0f }, { "basisComponents", 2.0f }, { "compactHRIRs", 1.0f },
+                                                           { "quality", 1.0f }, { "sharedEngine", 1.0f }, { "lockMemory", 1.0f } };
+        for (const auto& [id, value] : settings)
+        {
+            setParameter (processor, id, value);
+            pumpMessages (400);
+        }
+
+        for (const auto& [id, value] : settings)
+        {
+            juce::ignoreUnused (value);
+            setParameter (processor, id, 0.0f);
+            pumpMessages (400);
+        }
+
+        // another folder into the selected slot, then a state restore (which loads in the background)
+        processor.setHRTFDirectory (sadie.getChildFile ("D2_HRIR_WAV"));
+        pumpMessages (300);
+
+        juce::MemoryBlock state;
+        processor.getStateInformation (state);
+        processor.setStateInformation (state.getData(), (int) state.getSize());
+        pumpMessages (1000);
+
+        host.stopThread (2000);
+        processor.releaseResources();
+
+        expectEquals (RealtimeSafetyChecker::getNumViolations() - violationsBefore, 0, "Realtime violations inside processBlock");
+        expectEquals (host.badSamples.load(), 0, "Non-finite or runaway output samples");
+        expectGreaterThan (host.numBlocks.load(), 100, "The audio thread hardly ran");
+    }
+};
+
+static RealtimeSafetyTest realtimeSafetyTest;
@@ -0,0 +1,125 @@
+// The 16-bit HRIR storage against the float one, set by set: every IR as fetchIR() hands it to the
+// convolvers, and what a convolver makes of noise through a spread of directions. Both have to stay
+// within maxErrorDb of the float32 version, relative to its own level.
+#include <JuceHeader.h>
+#include "TestData.h"
+#include "../../Source/HRTFDatabase.h"
+#include "../../Source/PartitionedConvolver.h"
+
+class SampleFormatTest : public juce::UnitTest
+{
+public:
+    SampleFormatTest() : juce::UnitTest ("16-bit HRIRs", "HRTFDatabase") {}
+
+    static constexpr double maxErrorDb = -80.0;
+
+    void runTest() override
+    {
+        const auto sadie = TestData::findSADIE();
+        beginTest ("The SADIE sets are there");
+        expect (sadie.isDirectory(), "No SADIE folder above the runner or the working directory");
+        if (!sadie.isDirectory())
+            return;
+
+        for (const auto& folder : { "D1_HRIR_WAV", "D2_HRIR_WAV", "H3_HRIR_WAV", "H4_HRIR_WAV", "H12_HRIR_WAV", "H20_HRIR_WAV" })
+            compare (sadie.getChildFile (folder), 48000.0);
+
+        // the other two sample rates: 16-bit sources, and twice the IR length
+        compare (sadie.getChildFile ("D1_HRIR_WAV"), 44100.0);
+        compare (sadie.getChildFile ("D1_HRIR_WAV"), 96000.0);
+    }
+
+private:
+    static double toDb (double errorEnergy, double signalEnergy)
+    {
+        return signalEnergy > 0.0 ? 10.0 * std::log10 (juce::jmax (errorEnergy / signalEnergy, 1.0e-30)) : -300.0;
+    }
+
+    void compare (const juce::File& folder, double sampleRate)
+    {
+        beginTest (folder.getFileName() + " at " + juce::String (sampleRate / 1000.0, 1) + " kHz");
+
+        const auto reference = HRTFDatabase::loadFromFolder (folder, sampleRate);
+        const auto compact = HRTFDatabase::loadFromFolder (folder, sampleRate);
+        expect (reference != nullptr && compact != nullptr, "Couldn't load " + folder.getFullPathName());
+        if (reference == nullptr || compact == nullptr)
+            return;
+
+        compact->convertTo16Bit();
+        expect (compact->getSampleFormat() == HRTFDatabase::SampleFormat::int16, "Not converted");
+
+        const int length = reference->getIRLength();
+        std::vector<float> referenceScratch ((size_t) HRTFDatabase::fetchScratchSize), compactScratch ((size_t) HRTFDatabase::fetchScratchSize);
+
+        // 1. the IRs themselves, every one, each ear against its own energy
+        double worstIR = -300.0;
+        for (int i = 0; i < reference->getNumIRs(); ++i)
+        {
+            const auto a = reference->fetchIR (i, referenceScratch.data());
+            const auto b = compact->fetchIR (i, compactScratch.data());
+
+            for (const auto& [x, y] : { std::make_pair (a.left, b.left), std::make_pair (a.right, b.right) })
+            {
+                double signal = 0.0, error = 0.0;
+                for (int n = 0; n < length; ++n)
+                {
+                    signal += (double) x[n] * x[n];
+                    error += ((double) y[n] - x[n]) * ((double) y[n] - x[n]);
+                }
+
+                worstIR = juce::jmax (worstIR, toDb (error, signal));
+            }
+        }
+
+        logMessage ("  worst IR error " + juce::String (worstIR, 1) + " dB (load report " + juce::String (compact->getStorageErrorDb(), 1) + " dB)");
+        expectLessOrEqual (worstIR, maxErrorDb, "IR error");
+        expectLessOrEqual ((double) compact->getStorageErrorDb(), maxErrorDb, "Reported IR error");
+
+        // 2. noise through both convolvers, 64 directions spread over the set, measured once the kernel is fully in
+        constexpr int blockSize = 128, numDirections = 64, blocksPerDirection = 16, settleBlocks = 8;
+        PartitionedConvolver referenceConvolver, compactConvolver;
+        referenceConvolver.prepare (blockSize);
+        compactConvolver.prepare (blockSize);
+
+        std::vector<float> input ((size_t) blockSize), referenceL ((size_t) blockSize), referenceR ((size_t) blockSize),
+                           compactL ((size_t) blockSize), compactR ((size_t) blockSize);
+        juce::Random random (reference->getNumIRs());
+        double worstOutput = -300.0;
+
+        for (int d = 0; d < numDirections; ++d)
+        {
+            const int index = (int) ((juce::int64) d * reference->getNumIRs() / numDirections);
+            const auto a = reference->fetchIR (index, referenceScratch.data());
+            const auto b = compact->fetchIR (index, compactScratch.data());
+            referenceConvolver.setKernel (index, a.left, a.right, length);
+            compactConvolver.setKernel (index, b.left, b.right, length);
+
+            double signal = 0.0, error = 0.0;
+            for (int block = 0; block < blocksPerDirection; ++block)
+            {
+                for (auto& x : input)
+                    x = random.nextFloat() * 2.0f - 1.0f;
+
+                referenceConvolver.process (input.data(), referenceL.data(), referenceR.data(), blockSize);
+                compactConvolver.process (input.data(), compactL.data(), compactR.data(), blockSize);
+
+                if (block < settleBlocks)
+                    continue;
+
+                for (int n = 0; n < blockSize; ++n)
+                {
+                    signal += (double) referenceL[(size_t) n] * referenceL[(size_t) n] + (double) referenceR[(size_t) n] * referenceR[(size_t) n];
+                    error += juce::square ((double) compactL[(size_t) n] - referenceL[(size_t) n])
+                           + juce::square ((double) compactR[(size_t) n] - referenceR[(size_t) n]);
+                }
+            }
+
+            worstOutput = juce::jmax (worstOutput, toDb (error, signal));
+        }
+
+        logMessage ("  worst convolved output error " + juce::String (worstOutput, 1) + " dB");
+        expectLessOrEqual (worstOutput, maxErrorDb, "Convolved output error");
+    }
+};
+
+static SampleFormatTest sampleFormatTest;
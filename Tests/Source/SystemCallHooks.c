@@ -0,0 +1,124 @@
+// Test runner only: the C library's locks, waits, sleeps and blocking I/O, reported through
+// annieRealtimeViolation() (AllocatorHooks.cpp) before they run, so any of them made inside an audio
+// callback is a violation. Outside a callback they cost one thread-local check.
+//
+// Linux: defined here under their own names; the runner is linked with -rdynamic, so these win over
+// libc's for every library in the process, and the real call is looked up behind them (RTLD_NEXT).
+// macOS: dyld's __interpose section puts them in place of the real ones everywhere but this file,
+// which calls the real ones by name.
+//
+// C rather than C++, so the definitions match the library's declarations as they are. Calls that
+// never block (trylock, unlock, signalling a condition, getrusage ...) are left alone.
+#undef _FORTIFY_SOURCE // its inline read / open wrappers would clash with the definitions below
+#if defined (__linux__)
+ #define _GNU_SOURCE // RTLD_NEXT
+#endif
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+void annieRealtimeViolation (const char* what);
+
+#if defined (__linux__)
+
+// resolved on first use; racing threads all store the same pointer
+static void* nextSymbol (void** slot, const char* name)
+{
+    void* p = __atomic_load_n (slot, __ATOMIC_RELAXED);
+
+    if (p == NULL)
+    {
+        p = dlsym (RTLD_NEXT, name);
+        __atomic_store_n (slot, p, __ATOMIC_RELAXED);
+    }
+
+    return p;
+}
+
+#define CHECKED_CALL(ret, name, params, args, what) \
+    ret name params \
+    { \
+        static void* next = NULL; \
+        annieRealtimeViolation (what); \
+        return ((ret (*) params) nextSymbol (&next, #name)) args; \
+    }
+
+int open (const char* path, int flags, ...)
+{
+    static void* next = NULL;
+    int mode = 0;
+
+   #ifdef O_TMPFILE
+    if ((flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE)
+   #else
+    if ((flags & O_CREAT) != 0)
+   #endif
+    {
+        va_list rest;
+        va_start (rest, flags);
+        mode = va_arg (rest, int);
+        va_end (rest);
+    }
+
+    annieRealtimeViolation ("file I/O (open)");
+    return ((int (*) (const char*, int, ...)) nextSymbol (&next, "open")) (path, flags, mode);
+}
+
+#elif defined (__APPLE__)
+
+#define CHECKED_CALL(ret, name, params, args, what) \
+    static ret checked_##name params \
+    { \
+        annieRealtimeViolation (what); \
+        return name args; \
+    } \
+    __attribute__ ((used, section ("__DATA,__interpose"))) \
+    static const void* const interpose_##name[2] = { (const void*) &checked_##name, (const void*) &name };
+
+static int checked_open (const char* path, int flags, ...)
+{
+    int mode = 0;
+
+    if ((flags & O_CREAT) != 0)
+    {
+        va_list rest;
+        va_start (rest, flags);
+        mode = va_arg (rest, int);
+        va_end (rest);
+    }
+
+    annieRealtimeViolation ("file I/O (open)");
+    return open (path, flags, mode);
+}
+
+__attribute__ ((used, section ("__DATA,__interpose")))
+static const void* const interpose_open[2] = { (const void*) &checked_open, (const void*) &open };
+
+#endif
+
+#ifdef CHECKED_CALL
+
+CHECKED_CALL (int, pthread_mutex_lock,     (pthread_mutex_t* m),  (m), "lock (pthread_mutex_lock)")
+CHECKED_CALL (int, pthread_rwlock_rdlock,  (pthread_rwlock_t* l), (l), "lock (pthread_rwlock_rdlock)")
+CHECKED_CALL (int, pthread_rwlock_wrlock,  (pthread_rwlock_t* l), (l), "lock (pthread_rwlock_wrlock)")
+CHECKED_CALL (int, pthread_cond_wait,      (pthread_cond_t* c, pthread_mutex_t* m), (c, m), "wait (pthread_cond_wait)")
+CHECKED_CALL (int, pthread_cond_timedwait, (pthread_cond_t* c, pthread_mutex_t* m, const struct timespec* t), (c, m, t), "wait (pthread_cond_timedwait)")
+CHECKED_CALL (int, pthread_join,           (pthread_t t, void** result), (t, result), "wait (pthread_join)")
+CHECKED_CALL (int, sem_wait,               (sem_t* s), (s), "wait (sem_wait)")
+
+CHECKED_CALL (int, nanosleep,   (const struct timespec* t, struct timespec* left), (t, left), "sleep (nanosleep)")
+CHECKED_CALL (int, usleep,      (useconds_t us), (us), "sleep (usleep)")
+CHECKED_CALL (int, sched_yield, (void), (), "sleep (sched_yield)")
+
+CHECKED_CALL (ssize_t, read,  (int fd, void* data, size_t size), (fd, data, size), "file I/O (read)")
+CHECKED_CALL (ssize_t, write, (int fd, const void* data, size_t size), (fd, data, size), "file I/O (write)")
+CHECKED_CALL (FILE*,   fopen, (const char* path, const char* mode), (path, mode), "file I/O (fopen)")
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Where the tests find the bundled SADIE sets: the first SADIE folder up from the runner (wherever the
+// exporter put it) or from the working directory. Invalid if there is none.
+namespace TestData
+{
+    inline juce::File findSADIE()
+    {
+        for (auto start : { juce::File::getSpecialLocation (juce::File::currentExecutableFile), juce::File::getCurrentWorkingDirectory() })
+        {
+            for (auto dir = start; ; dir = dir.getParentDirectory())
+            {
+                const auto candidate = dir.getChildFile ("SADIE");
+                if (candidate.isDirectory())
+                    return candidate;
+
+                if (dir.getParentDirectory() == dir)
+                    break;
+            }
+        }
+
+        return {};
+    }
+
+    // four subjects with different heads, one per plugin subject slot
+    inline juce::StringArray getSubjectFolders() { return { "D1_HRIR_WAV", "H3_HRIR_WAV", "H12_HRIR_WAV", "H20_HRIR_WAV" }; }
+}